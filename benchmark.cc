@@ -0,0 +1,420 @@
+// measure the throughput of each kernel of the coder on a set of corpora, and report it as a table and as JSON
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) or defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <fmt/printf.h>
+
+#include "bitreader.h"
+#include "bitstream.h"
+#include "bitwriter.h"
+#include "cpu.h"
+#include "decoder.h"
+#include "huffman.h"
+#include "tans.h"
+
+
+// a corpus, split into messages that are coded independently
+struct corpus {
+  std::string name;
+  std::vector<uint8_t> data;
+  size_t message_size = 0;  // size of each message, or 0 for a single message
+};
+
+// measurement of a kernel on a corpus
+struct result {
+  std::string corpus;
+  std::string kernel;
+  std::string variant;
+  uint64_t bytes = 0;     // number of input bytes processed by one run
+  double seconds = 0;     // best time of one run
+  double cycles = 0;      // time stamp counter cycles of the best run, or 0 if there is no counter
+};
+
+// value of the time stamp counter, or 0 if there is none
+inline uint64_t cycles() {
+#if defined(__x86_64__) or defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// results that the compiler cannot discard
+static volatile uint64_t sink = 0;
+
+// best time of several runs of `run`: at least three runs and `min_time` seconds in total, unless a single run is longer than
+// `min_time`, so that the slow variants do not take too long
+template <typename Function>
+std::pair<double, double> measure(Function&& run, double min_time) {
+  double best_seconds = INFINITY, best_cycles = INFINITY, total = 0;
+  for (int runs = 0; total < min_time or (runs < 3 and total < 2 * min_time); ++runs) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = cycles();
+    run();
+    uint64_t end_cycles = cycles();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    best_seconds = std::min(best_seconds, seconds);
+    best_cycles = std::min(best_cycles, static_cast<double>(end_cycles - start_cycles));
+    total += seconds;
+  }
+  return {best_seconds, best_cycles};
+}
+
+// parse a size in bytes, with an optional k, M or G suffix; return 0 if it is not valid
+uint64_t parse_size(const char* arg) {
+  char* suffix;
+  uint64_t size = std::strtoull(arg, &suffix, 10);
+  switch (*suffix) {
+    case 'k': size <<= 10; ++suffix; break;
+    case 'M': size <<= 20; ++suffix; break;
+    case 'G': size <<= 30; ++suffix; break;
+  }
+  return *suffix == '\0' ? size : 0;
+}
+
+// lines of text made of words drawn from a vocabulary with Zipf-distributed frequencies
+std::vector<uint8_t> generate_text(size_t size, std::mt19937& random) {
+  std::vector<std::string> words;
+  std::vector<double> frequencies;
+  for (int i = 0; i < 4000; ++i) {
+    std::string word;
+    for (size_t length = 2 + random() % 9; word.size() < length;) {
+      word += static_cast<char>('a' + random() % 26);
+    }
+    words.push_back(word);
+    frequencies.push_back(1.0 / (i + 1));
+  }
+  std::discrete_distribution<int> zipf(frequencies.begin(), frequencies.end());
+  std::vector<uint8_t> text;
+  text.reserve(size + 16);
+  while (text.size() < size) {
+    std::string const& word = words[zipf(random)];
+    text.insert(text.end(), word.begin(), word.end());
+    text.push_back(random() % 12 == 0 ? '\n' : random() % 10 == 0 ? ',' : ' ');
+  }
+  text.resize(size);
+  return text;
+}
+
+// records of 16 sensor readings, stored as the zigzag-mapped difference from the previous record: most differences are zero,
+// and the others are small
+std::vector<uint8_t> generate_telemetry(size_t size, std::mt19937& random) {
+  std::geometric_distribution<int> delta(0.6);
+  std::vector<uint8_t> telemetry(size);
+  for (size_t i = 0; i < size; ++i) {
+    int value = random() % 8 < 6 ? 0 : 1 + std::min(delta(random), 100);
+    telemetry[i] = static_cast<uint8_t>(random() % 2 ? 2 * value - 1 : 2 * value);
+  }
+  return telemetry;
+}
+
+// the synthetic corpora of `size` bytes
+std::vector<corpus> generate_corpora(size_t size) {
+  std::mt19937 random(42);
+  std::vector<corpus> corpora;
+  corpus uniform{"uniform", std::vector<uint8_t>(size)};
+  for (uint8_t& byte : uniform.data) {
+    byte = static_cast<uint8_t>(random());
+  }
+  corpora.push_back(std::move(uniform));
+  corpora.push_back({"text", generate_text(size, random)});
+  corpora.push_back({"telemetry", generate_telemetry(size, random)});
+  corpora.push_back({"single", std::vector<uint8_t>(size, 'a')});
+  // 1 KiB messages of text, at most 1 MiB of them, each coded with its own table
+  corpora.push_back({"tiny", generate_text(std::min<size_t>(size, 1 << 20), random), 1024});
+  return corpora;
+}
+
+// read the whole file `name` into `data`
+bool load(const char* name, std::vector<uint8_t>& data) {
+  std::ifstream file(name, std::ios::binary);
+  data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return not file.bad() and file.is_open();
+}
+
+// measure each kernel, and its variants, on the messages of `input`; the variants that are much slower than the others only
+// process the first `slow_size` bytes of each message
+void run_kernels(corpus const& input, double min_time, size_t slow_size, std::vector<result>& results) {
+  // split the corpus into messages
+  struct message {
+    uint8_t const* data;
+    size_t size;
+    huffman_encoding encoding;
+    std::vector<uint8_t> encoded;  // the serialised coding followed by the encoded message
+    tans_encoding tans;
+    std::vector<uint8_t> tans_encoded;
+  };
+  std::vector<message> messages;
+  size_t step = input.message_size ? input.message_size : input.data.size();
+  for (size_t offset = 0; offset < input.data.size(); offset += step) {
+    messages.push_back({input.data.data() + offset, std::min(step, input.data.size() - offset)});
+  }
+  uint64_t bytes = input.data.size(), slow_bytes = 0;
+  for (message& m : messages) {
+    slow_bytes += std::min(m.size, slow_size);
+  }
+
+  auto add = [&](const char* kernel, const char* variant, uint64_t processed, auto&& run) {
+    auto [seconds, cycles] = measure(run, min_time);
+    results.push_back({input.name, kernel, variant, processed, seconds, cycles});
+    result const& r = results.back();
+    fmt::printf("%-10s %-28s %-13s %10.1f MB/s %8.2f cycles/byte\n", r.corpus, r.kernel, r.variant, r.bytes / r.seconds / 1e6,
+                r.cycles / r.bytes);
+    std::fflush(stdout);
+  };
+
+  // building the coding
+  add("scan_input", "histogram", bytes, [&]() {
+    for (message& m : messages) {
+      m.encoding = huffman_encoding();
+      m.encoding.scan_input(m.data, m.size);
+    }
+  });
+  add("get_code_lenghts_from_data", "package-merge", bytes, [&]() {
+    for (message& m : messages) {
+      m.encoding.get_code_lenghts_from_data(15);
+    }
+  });
+  add("build_canonical_coding", "canonical", bytes, [&]() {
+    for (message& m : messages) {
+      m.encoding.build_canonical_coding();
+    }
+  });
+  for (message& m : messages) {
+    m.encoding.use_compact_header();
+  }
+
+  // encoding
+  add("encode", "bitwriter", bytes, [&]() {
+    for (message& m : messages) {
+      bitwriter writer;
+      m.encoding.serialise(writer);
+      m.encoding.encode(m.data, m.size, writer);
+      writer.flush();
+      m.encoded.assign(writer.data(), writer.data() + writer.bytes());
+    }
+  });
+  add("encode", "bitstream", slow_bytes, [&]() {
+    for (message& m : messages) {
+      bitstream stream;
+      m.encoding.encode(m.data, std::min(m.size, slow_size), stream);
+      sink = sink + stream.size();
+    }
+  });
+  add("encode", "tans", bytes, [&]() {
+    for (message& m : messages) {
+      m.tans.build_from_weights(m.encoding.weights_, m.encoding.original_size_);
+      m.tans.encode(m.data, m.size);
+      bitwriter writer;
+      m.tans.serialise(writer);
+      m.tans.write(writer);
+      writer.flush();
+      m.tans_encoded.assign(writer.data(), writer.data() + writer.bytes());
+    }
+  });
+
+  // reading the coding, and building the decoding tables
+  add("deserialise", "compact", bytes, [&]() {
+    for (message& m : messages) {
+      bitreader reader(m.encoded.data(), m.encoded.size() * 8);
+      huffman_encoding encoding;
+      encoding.deserialise(reader);
+      sink = sink + encoding.encoded_size_;
+    }
+  });
+  std::vector<huffman_decoder> decoders(messages.size()), multi_decoders(messages.size(), huffman_decoder(huffman_decoder::default_table_bits, huffman_table_type::multi_symbol));
+  add("build_decoder", "single_symbol", bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      decoders[i].build(messages[i].encoding);
+    }
+  });
+  add("build_decoder", "multi_symbol", bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      multi_decoders[i].build(messages[i].encoding);
+    }
+  });
+
+  // decoding
+  std::vector<uint8_t> out(step + huffman_decoder::max_symbols);
+  auto encoded_symbols = [](message const& m) {
+    bitreader reader(m.encoded.data(), m.encoded.size() * 8);
+    reader.seekg(m.encoding.header_size_);
+    return reader;
+  };
+  add("decode", "table", bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      bitreader reader = encoded_symbols(messages[i]);
+      sink = sink + decoders[i].decode(reader, out.data(), messages[i].size);
+    }
+  });
+  add("decode", "multi_symbol", bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      bitreader reader = encoded_symbols(messages[i]);
+      sink = sink + multi_decoders[i].decode(reader, out.data(), messages[i].size);
+    }
+  });
+  add("decode", "linear_scan", slow_bytes, [&]() {
+    for (message const& m : messages) {
+      bitreader reader = encoded_symbols(m);
+      for (size_t i = 0; i < std::min(m.size, slow_size) and m.encoding.decode(reader, out[i]); ++i) {
+      }
+    }
+  });
+  std::vector<bitstream> streams(messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    streams[i].from_bytes(messages[i].encoded);
+  }
+  add("decode", "bitstream", slow_bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      streams[i].seekg(messages[i].encoding.header_size_);
+      sink = sink + decoders[i].decode(streams[i], out.data(), std::min(messages[i].size, slow_size));
+    }
+  });
+  std::vector<tans_decoder> tans_decoders(messages.size());
+  for (size_t i = 0; i < messages.size(); ++i) {
+    tans_decoders[i].build(messages[i].tans);
+  }
+  add("decode", "tans", bytes, [&]() {
+    for (size_t i = 0; i < messages.size(); ++i) {
+      message const& m = messages[i];
+      bitreader reader(m.tans_encoded.data(), m.tans_encoded.size() * 8);
+      reader.seekg(m.tans.header_size_);
+      sink = sink + tans_decoders[i].decode(reader, out.data(), m.size);
+    }
+  });
+
+  // check that the fast decoders give back the corpus
+  for (size_t i = 0; i < messages.size(); ++i) {
+    message const& m = messages[i];
+    bitreader reader = encoded_symbols(m);
+    bitreader tans_reader(m.tans_encoded.data(), m.tans_encoded.size() * 8);
+    tans_reader.seekg(m.tans.header_size_);
+    if (multi_decoders[i].decode(reader, out.data(), m.size) != m.size or not std::equal(m.data, m.data + m.size, out.begin()) or
+        tans_decoders[i].decode(tans_reader, out.data(), m.size) != m.size or not std::equal(m.data, m.data + m.size, out.begin())) {
+      std::cerr << "error: the " << input.name << " corpus is not decoded correctly" << std::endl;
+      std::exit(1);
+    }
+  }
+}
+
+// escape a string for JSON
+std::string quote(std::string const& value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    if (c == '"' or c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted += fmt::sprintf("\\u%04x", c);
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// write the results as a JSON document
+void write_json(std::ostream& out, std::vector<corpus> const& corpora, std::vector<result> const& results) {
+  out << "{\n  \"cpu\": " << quote(cpu::name(cpu::selected())) << ",\n  \"corpora\": [\n";
+  for (size_t i = 0; i < corpora.size(); ++i) {
+    out << fmt::sprintf("    {\"name\": %s, \"bytes\": %d, \"message_size\": %d}%s\n", quote(corpora[i].name), corpora[i].data.size(),
+                        corpora[i].message_size, i + 1 < corpora.size() ? "," : "");
+  }
+  out << "  ],\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    result const& r = results[i];
+    std::string cycles = r.cycles > 0 ? fmt::sprintf("%.4f", r.cycles / r.bytes) : "null";
+    out << fmt::sprintf("    {\"corpus\": %s, \"kernel\": %s, \"variant\": %s, \"bytes\": %d, \"seconds\": %.9f, \"mb_per_s\": %.2f, "
+                        "\"cycles_per_byte\": %s}%s\n",
+                        quote(r.corpus), quote(r.kernel), quote(r.variant), r.bytes, r.seconds, r.bytes / r.seconds / 1e6, cycles,
+                        i + 1 < results.size() ? "," : "");
+  }
+  out << "  ]\n}\n";
+}
+
+
+int main(int argc, const char* argv[]) {
+  // no need to synchronise the C++ I/O streams with the C I/O streams
+  std::ios::sync_with_stdio(false);
+
+  // parse the command line options, and collect the names of the corpora to load
+  //   --size N           generate synthetic corpora of N bytes, with an optional k, M or G suffix (default: 16M)
+  //   --time S           run each kernel for at least S seconds, and keep the best run (default: 0.5)
+  //   --slow-size N      run the slow variants on the first N bytes of each message only (default: 1M)
+  //   --json FILE        write the results to FILE as JSON, or to the standard output if FILE is "-"
+  //   FILE...            measure the kernels on these files instead of the synthetic corpora
+  // The throughput is given in MB/s of input (10^6 bytes per second), and in cycles of the time stamp counter per byte of input.
+  size_t size = 16 << 20;
+  double min_time = 0.5;
+  size_t slow_size = 1 << 20;
+  const char* json_name = nullptr;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--size") == 0 and i + 1 < argc) {
+      size = parse_size(argv[++i]);
+      if (size == 0) {
+        std::cerr << "invalid corpus size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--time") == 0 and i + 1 < argc) {
+      min_time = std::atof(argv[++i]);
+    } else if (strcmp(argv[i], "--slow-size") == 0 and i + 1 < argc) {
+      slow_size = parse_size(argv[++i]);
+      if (slow_size == 0) {
+        std::cerr << "invalid size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--json") == 0 and i + 1 < argc) {
+      json_name = argv[++i];
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+
+  std::vector<corpus> corpora;
+  if (args.empty()) {
+    corpora = generate_corpora(size);
+  }
+  for (const char* name : args) {
+    corpus file{name};
+    if (not load(name, file.data)) {
+      std::cerr << "cannot read the corpus " << name << std::endl;
+      return 1;
+    }
+    corpora.push_back(std::move(file));
+  }
+
+  fmt::printf("kernels selected for %s\n", cpu::name(cpu::selected()));
+  std::vector<result> results;
+  for (corpus const& input : corpora) {
+    run_kernels(input, min_time, slow_size, results);
+  }
+
+  if (json_name and strcmp(json_name, "-") == 0) {
+    write_json(std::cout, corpora, results);
+  } else if (json_name) {
+    std::ofstream json(json_name);
+    write_json(json, corpora, results);
+    if (not json) {
+      std::cerr << "cannot write the results to " << json_name << std::endl;
+      return 1;
+    }
+  }
+  return 0;
+}
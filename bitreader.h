@@ -0,0 +1,164 @@
+#ifndef bitreader_h
+#define bitreader_h
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+/* read-only stream-like class that supports extraction bit by bit, from a contiguous buffer
+ *
+ * The next bits are kept in a 64-bit buffer, that is refilled with a single unaligned 8-byte load; after a refill the buffer
+ * holds at least `min_bits` bits, that can be accessed with peek(n) and consume(n) without any further check.
+ *
+ * To avoid checking for the end of the stream on every refill, refill() must only be called while has_word() is true, or if the
+ * underlying memory is readable for at least `padding` bytes after the last byte of the stream.
+ *
+ * The bitstream-like interface (tellg, seekg, peek, read and skip with an explicit number of bits) is also supported, and does
+ * check for the end of the stream.
+ *
+ * The bitreader does not own the memory, and never reads past the last byte of the stream except through an unchecked refill():
+ * it can be used as a read-only view over external memory, like a memory-mapped file, without copying the data.
+ */
+
+// little endian implementation: the "first" bit is the LSB of the first byte
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "bitreader assumes a little endian architecture"
+#endif
+
+class bitreader {
+public:
+  using size_type = uint64_t;
+  using word_type = uint64_t;
+
+  static constexpr size_type word_size = sizeof(word_type) * 8;  // number of bits in a word
+  static constexpr size_type min_bits = word_size - 8;           // number of bits guaranteed to be available after a refill
+  static constexpr size_type padding = sizeof(word_type);        // number of bytes read past the end of the data by refill()
+
+  // construct an empty reader
+  bitreader() = default;
+
+  // construct a reader for the first `bitcount` bits of `data`
+  bitreader(void const* data, size_type bitcount) : data_(static_cast<uint8_t const*>(data)) {
+    truncate(bitcount);
+    seekg(0);
+  }
+
+  // size of the stream, in bits
+  size_type size() const { return size_; }
+
+  // shorten the stream to `bitcount` bits; the read pointer is moved to the end of the stream if it is beyond the new size
+  void truncate(size_type bitcount) {
+    size_ = bitcount;
+    if (next_ and tellg() > size_) {
+      seekg(size_);
+    }
+  }
+
+  // return true if the next refill() can load a whole word from within the stream; this also implies that there are at least
+  // `word_size` bits left in the stream
+  bool has_word() const { return next_ + sizeof(word_type) <= data_ + size_ / 8; }
+
+  // return the position of the read pointer
+  size_type tellg() const { return (next_ - data_) * 8 - bits_; }
+
+  // rewind / advance the read pointer to position `pos`, or the end of the stream
+  void seekg(size_type pos) {
+    pos = std::min(pos, size_);
+    next_ = data_ + pos / 8;
+    buffer_ = load(next_);
+    next_ += (word_size - 1) >> 3;
+    bits_ = min_bits;
+    consume(pos % 8);
+  }
+
+  // refill the bit buffer, so that it holds at least `min_bits` bits
+  void refill() {
+    word_type word;
+    std::memcpy(&word, next_, sizeof(word_type));
+    buffer_ |= word << bits_;
+    next_ += (word_size - 1 - bits_) >> 3;
+    bits_ |= min_bits;
+  }
+
+  // return the next `count` bits, without advancing the read pointer; `count` must not be larger than the bit buffer
+  word_type peek(size_type count) const {
+    assert(count <= bits_ and count < word_size);
+    return buffer_ & ((static_cast<word_type>(1) << count) - 1);
+  }
+
+  // advance the read pointer by `count` bits; `count` must not be larger than the bit buffer
+  void consume(size_type count) {
+    assert(count <= bits_);
+    buffer_ >>= count;
+    bits_ -= count;
+  }
+
+  // peek up to `count` bits from the stream into `value`, and return the number of bits actually read
+  template <typename T>
+  size_type peek(size_type count, T& value) const {
+    // check that the parameters are valid
+    assert(count <= sizeof(T) * 8);
+    // do not read past the end of the stream
+    size_type pos = tellg();
+    count = std::min(count, size_ - pos);
+    if (count == 0) {
+      value = 0;
+      return 0;
+    }
+    // read one word starting from the byte that contains the read pointer, and one more byte if needed
+    word_type word = load(data_ + pos / 8);
+    word >>= pos % 8;
+    if (pos % 8 and count > word_size - pos % 8) {
+      word |= static_cast<word_type>(data_[pos / 8 + sizeof(word_type)]) << (word_size - pos % 8);
+    }
+    if (count < word_size) {
+      word &= (static_cast<word_type>(1) << count) - 1;
+    }
+    value = static_cast<T>(word);
+    return count;
+  }
+
+  // read up to `count` bits from the stream into `value`, and return the number of bits actually read
+  template <typename T>
+  size_type read(size_type count, T& value) {
+    size_type read = peek(count, value);
+    skip(read);
+    return read;
+  }
+
+  // skip up to `count` bits from the stream, and return the number of bits actually skipped
+  size_type skip(size_type count) {
+    // do not skip past the end of the stream
+    size_type pos = tellg();
+    count = std::min(count, size_ - pos);
+    if (count <= bits_) {
+      consume(count);
+    } else {
+      seekg(pos + count);
+    }
+    return count;
+  }
+
+private:
+  // load a word from `ptr`, without reading past the last byte of the stream
+  word_type load(uint8_t const* ptr) const {
+    word_type word = 0;
+    uint8_t const* end = data_ + (size_ + 7) / 8;
+    if (ptr + sizeof(word_type) <= end) {
+      std::memcpy(&word, ptr, sizeof(word_type));
+    } else if (ptr < end) {
+      std::memcpy(&word, ptr, end - ptr);
+    }
+    return word;
+  }
+
+  uint8_t const* data_ = nullptr;  // beginning of the stream
+  uint8_t const* next_ = nullptr;  // next byte to be loaded into the bit buffer
+  size_type size_ = 0;             // size of the stream, in bits
+  word_type buffer_ = 0;           // bit buffer
+  size_type bits_ = 0;             // number of valid bits in the bit buffer
+};
+
+#endif  // bitreader_h
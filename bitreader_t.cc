@@ -0,0 +1,106 @@
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+
+int main(int argc, const char* argv[]) {
+  // write a random sequence of values of random lengths
+  std::mt19937_64 random(42);
+  std::vector<std::pair<unsigned int, uint64_t>> values;
+  bitwriter writer;
+  for (int i = 0; i < 100000; ++i) {
+    unsigned int count = random() % 65;
+    uint64_t value = random();
+    if (count < 64) {
+      value &= (1ul << count) - 1;
+    }
+    values.emplace_back(count, value);
+    writer.write(count, value);
+  }
+  writer.flush();
+
+  // copy the data to a buffer of the exact size, and to one with enough padding for an unchecked refill()
+  std::vector<uint8_t> buffer(writer.data(), writer.data() + writer.bytes());
+  std::vector<uint8_t> padded(buffer);
+  padded.resize(buffer.size() + bitreader::padding, 0);
+
+  {
+    // read the values back with the bitstream-like interface
+    bitreader reader(buffer.data(), writer.size());
+    for (auto [count, expected] : values) {
+      uint64_t value;
+      size_t read = reader.read(count, value);
+      assert(read == count and value == expected);
+    }
+    assert(reader.tellg() == reader.size());
+
+    // check that no bits are read past the end of the stream
+    uint64_t value;
+    auto read = reader.read(64, value);
+    assert(read == 0);
+    std::cout << "read " << values.size() << " values with read(count, value)" << std::endl;
+  }
+
+  {
+    // read the values back with the refill / peek / consume interface, splitting the values longer than the bit buffer
+    bitreader reader(padded.data(), writer.size());
+    for (auto [count, expected] : values) {
+      reader.refill();
+      uint64_t value;
+      if (count <= bitreader::min_bits) {
+        value = reader.peek(count);
+        reader.consume(count);
+      } else {
+        value = reader.peek(32);
+        reader.consume(32);
+        reader.refill();
+        value |= reader.peek(count - 32) << 32;
+        reader.consume(count - 32);
+      }
+      assert(value == expected);
+    }
+    assert(reader.tellg() == reader.size());
+    std::cout << "read " << values.size() << " values with refill() / peek(count) / consume(count)" << std::endl;
+  }
+
+  {
+    // seek to the position of each value, and read it back
+    bitreader reader(buffer.data(), writer.size());
+    size_t pos = 0;
+    std::vector<size_t> positions;
+    for (auto [count, expected] : values) {
+      positions.push_back(pos);
+      pos += count;
+    }
+    for (size_t i = values.size(); i > 0; --i) {
+      auto [count, expected] = values[i - 1];
+      reader.seekg(positions[i - 1]);
+      uint64_t value;
+      size_t read = reader.peek(count, value);
+      assert(read == count and value == expected);
+    }
+    std::cout << "read " << values.size() << " values with seekg(pos) / peek(count, value)" << std::endl;
+  }
+
+  {
+    // read the values back with the refill / peek / consume interface while a whole word is available, and with the
+    // bitstream-like interface close to the end of the stream
+    bitreader reader(buffer.data(), writer.size());
+    for (auto [count, expected] : values) {
+      uint64_t value;
+      if (reader.has_word() and count <= bitreader::min_bits) {
+        reader.refill();
+        value = reader.peek(count);
+        reader.consume(count);
+      } else {
+        reader.read(count, value);
+      }
+      assert(value == expected);
+    }
+    assert(reader.tellg() == reader.size());
+    std::cout << "read " << values.size() << " values from unpadded memory" << std::endl;
+  }
+}
@@ -0,0 +1,289 @@
+#ifndef bitwriter_h
+#define bitwriter_h
+
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "cpu.h"
+
+/* write-only stream-like class that supports insertion bit by bit, backed by contiguous storage
+ *
+ * The bits are accumulated in a 64-bit word, that is stored to the underlying buffer only when it is full: writing a symbol is
+ * a shift and an OR, and the capacity of the buffer is checked only when a whole word is stored. If enough space has been
+ * reserved in advance, the buffer is never reallocated.
+ *
+ * A whole sequence of codes can be appended with write_codes(), that keeps the bits in registers and stores them with one
+ * unaligned 8-byte store for every one or two codes, after checking the capacity of the buffer once for the whole sequence; the
+ * kernel has a variant compiled for AVX2 and BMI2, selected at run time (see cpu.h).
+ *
+ * The underlying buffer is either owned by the bitwriter and grows as needed, or is provided by the caller, e.g. a memory-mapped
+ * output file; in the latter case the bitwriter never writes past the end of the buffer, and throws an std::length_error if
+ * the buffer is too small.
+ */
+
+// little endian implementation: the "first" bit is the LSB of the first byte
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "bitwriter assumes a little endian architecture"
+#endif
+
+class bitwriter {
+public:
+  using size_type = uint64_t;
+  using word_type = uint64_t;
+  using value_type = bool;
+
+  static constexpr size_type word_size = sizeof(word_type) * 8;  // number of bits in a word
+  static constexpr size_type bulk_max_length = word_size - 8;     // longest code written by the write_codes() kernel
+
+  // how many words are needed to store `bit_count` bits
+  static constexpr size_type to_word_count(size_type bit_count) { return (bit_count + word_size - 1) / word_size; }
+
+  // default constructor, using an owned buffer
+  bitwriter() = default;
+
+  // construct a bitwriter that writes to the caller-provided buffer `data`, of `bytes` bytes
+  bitwriter(void* data, size_type bytes) : data_(static_cast<uint8_t*>(data)), capacity_(bytes), external_(true) {}
+
+  // the owned buffer cannot be shared
+  bitwriter(bitwriter const&) = delete;
+  bitwriter& operator=(bitwriter const&) = delete;
+
+  // moving a std::vector does not move its data, so `data_` remains valid
+  bitwriter(bitwriter&&) = default;
+  bitwriter& operator=(bitwriter&&) = default;
+
+  // reserve space in the underlying buffer for `bitcount` bits; an owned buffer that already holds some data at least doubles, so
+  // that a stream written in many small pieces is copied only a few times
+  void reserve(size_type bitcount) {
+    if (capacity_ < (bitcount + 7) / 8) {
+      grow(std::max(to_word_count(bitcount), 2 * storage_.size()));
+    }
+  }
+
+  // number of bits written to the stream
+  size_type size() const { return words_ * word_size + bits_; }
+
+  // number of bytes needed to store all the bits written to the stream
+  size_type bytes() const { return (size() + 7) / 8; }
+
+  // return the position of the write pointer
+  size_type tellp() const { return size(); }
+
+  // number of bytes at the beginning of the underlying buffer that hold whole words, and will not change any more
+  size_type stored_bytes() const { return words_ * sizeof(word_type); }
+
+  // drop the whole words from the underlying buffer, once they have been copied elsewhere, so that the buffer can be reused for
+  // the next bits; the position of the write pointer is then relative to the first dropped word
+  void drop_stored() { words_ = 0; }
+
+  // reset and clear the stream
+  void reset() {
+    words_ = 0;
+    bits_ = 0;
+    accumulator_ = 0;
+  }
+
+  // write one bit to the stream
+  void write(value_type value) { write(1, static_cast<word_type>(value)); }
+
+  // append the first `count` bits from `value`
+  template <typename T>
+  void write(size_type count, T value) {
+    // check that the input parameters are valid
+    assert(count <= sizeof(T) * 8 and count <= word_size);
+    word_type bits = static_cast<word_type>(value);
+    if (count < word_size) {
+      bits &= (static_cast<word_type>(1) << count) - 1;
+    }
+
+    // add the new bits to the accumulator
+    accumulator_ |= bits << bits_;
+    bits_ += count;
+
+    // if the accumulator is full, store it and keep the bits that did not fit
+    if (bits_ >= word_size) {
+      store(accumulator_);
+      bits_ -= word_size;
+      accumulator_ = bits_ ? bits >> (count - bits_) : 0;
+    }
+  }
+
+  // append `bytes` bytes from `data` with a single copy; the stream must be at a byte boundary
+  void write_bytes(void const* data, size_type bytes) {
+    assert(bits_ % 8 == 0);
+    if (bytes == 0) {
+      return;
+    }
+    reserve(size() + bytes * 8);
+    // store the whole bytes of the accumulator, copy the data after them, and reload the last partial word into the accumulator
+    size_type position = words_ * sizeof(word_type) + bits_ / 8;
+    std::memcpy(data_ + words_ * sizeof(word_type), &accumulator_, bits_ / 8);
+    std::memcpy(data_ + position, data, bytes);
+    position += bytes;
+    words_ = position / sizeof(word_type);
+    bits_ = position % sizeof(word_type) * 8;
+    accumulator_ = 0;
+    std::memcpy(&accumulator_, data_ + words_ * sizeof(word_type), bits_ / 8);
+  }
+
+  // append all the bits written to `other`, which must have been flushed
+  void append(bitwriter const& other) {
+    size_type count = other.size();
+    if (not external_) {
+      reserve(size() + count);
+    }
+    size_type words = count / word_size;
+    for (size_type i = 0; i < words; ++i) {
+      word_type word;
+      std::memcpy(&word, other.data_ + i * sizeof(word_type), sizeof(word_type));
+      write(word_size, word);
+    }
+    if (size_type rest = count % word_size; rest > 0) {
+      word_type word = 0;
+      std::memcpy(&word, other.data_ + words * sizeof(word_type), (rest + 7) / 8);
+      write(rest, word);
+    }
+  }
+
+  // append the codes of the `count` symbols from `symbols`: the `lengths[s]` bits of `codes[s]` for each symbol s, where no length
+  // is larger than `max_length` bits, and no code has any bit set above its length
+  template <typename Symbol, typename Code, typename Length>
+  void write_codes(Symbol const* symbols, size_type count, Code const* codes, Length const* lengths, size_type max_length) {
+    if (count == 0) {
+      return;
+    }
+    assert(max_length > 0 and max_length <= word_size);
+    if (max_length > bulk_max_length) {
+      for (size_type i = 0; i < count; ++i) {
+        write(lengths[symbols[i]], codes[symbols[i]]);
+      }
+      return;
+    }
+    // the kernel stores a whole word at the last byte written so far, so that the buffer needs up to two more words than the codes
+    // themselves; the codes that would not fit in a caller-provided buffer are written one by one
+    if (not external_) {
+      reserve(size() + count * max_length + 2 * word_size);
+    }
+    size_type position = words_ * sizeof(word_type);
+    size_type room = capacity_ > position + 2 * sizeof(word_type) ? (capacity_ - position - 2 * sizeof(word_type)) * 8 : 0;
+    size_type bulk = std::min(count, room / max_length) & ~size_type(1);
+    if (bulk == 0) {
+      for (size_type i = 0; i < count; ++i) {
+        write(lengths[symbols[i]], codes[symbols[i]]);
+      }
+      return;
+    }
+
+#if WITHER_DISPATCH
+    if (cpu::selected() >= cpu::level::avx2) {
+      write_bulk_avx2(symbols, count, codes, lengths, max_length, bulk);
+      return;
+    }
+#endif
+    write_bulk(symbols, count, codes, lengths, max_length, bulk);
+  }
+
+  // store the partially filled word to the underlying buffer, so that data() contains all the bits written so far;
+  // further writes are still possible, and will overwrite it
+  void flush() {
+    // only store the bytes that are actually used
+    size_type bytes = (bits_ + 7) / 8;
+    if (words_ * sizeof(word_type) + bytes > capacity_) {
+      grow(words_ * 2 + 1);
+    }
+    std::memcpy(data_ + words_ * sizeof(word_type), &accumulator_, bytes);
+  }
+
+  // access the underlying buffer, valid up to the last call to flush()
+  uint8_t const* data() const { return data_; }
+
+private:
+  // kernel of write_codes(): write the first `bulk` codes, an even number that fits in the buffer with two words to spare, with
+  // whole-word stores, and the remaining ones one by one
+  template <typename Symbol, typename Code, typename Length>
+  [[gnu::always_inline]] void write_bulk(Symbol const* symbols, size_type count, Code const* codes, Length const* lengths, size_type max_length,
+                                         size_type bulk) {
+    // keep less than a byte in the accumulator after each store, so that two codes of up to 28 bits always fit
+    uint8_t* next = data_ + words_ * sizeof(word_type);
+    word_type accumulator = accumulator_;
+    size_type bits = bits_;
+    std::memcpy(next, &accumulator, sizeof(word_type));
+    next += bits >> 3;
+    accumulator >>= bits & ~size_type(7);
+    bits &= 7;
+    if (max_length <= bulk_max_length / 2) {
+      for (size_type i = 0; i < bulk; i += 2) {
+        accumulator |= static_cast<word_type>(codes[symbols[i]]) << bits;
+        bits += lengths[symbols[i]];
+        accumulator |= static_cast<word_type>(codes[symbols[i + 1]]) << bits;
+        bits += lengths[symbols[i + 1]];
+        std::memcpy(next, &accumulator, sizeof(word_type));
+        next += bits >> 3;
+        accumulator >>= bits & ~size_type(7);
+        bits &= 7;
+      }
+    } else {
+      for (size_type i = 0; i < bulk; ++i) {
+        accumulator |= static_cast<word_type>(codes[symbols[i]]) << bits;
+        bits += lengths[symbols[i]];
+        std::memcpy(next, &accumulator, sizeof(word_type));
+        next += bits >> 3;
+        accumulator >>= bits & ~size_type(7);
+        bits &= 7;
+      }
+    }
+
+    // restore the state of the writer from the bytes stored so far, and write the remaining codes one by one
+    size_type total = (next - data_) * 8 + bits;
+    words_ = total / word_size;
+    bits_ = total % word_size;
+    std::memcpy(&accumulator_, data_ + words_ * sizeof(word_type), sizeof(word_type));
+    accumulator_ &= (static_cast<word_type>(1) << bits_) - 1;
+    for (size_type i = bulk; i < count; ++i) {
+      write(lengths[symbols[i]], codes[symbols[i]]);
+    }
+  }
+
+#if WITHER_DISPATCH
+  // the same kernel, compiled for AVX2 and BMI2
+  template <typename Symbol, typename Code, typename Length>
+  WITHER_TARGET_AVX2 void write_bulk_avx2(Symbol const* symbols, size_type count, Code const* codes, Length const* lengths, size_type max_length,
+                                          size_type bulk) {
+    write_bulk(symbols, count, codes, lengths, max_length, bulk);
+  }
+#endif
+
+  // store a full word to the underlying buffer, growing it if needed
+  void store(word_type word) {
+    if ((words_ + 1) * sizeof(word_type) > capacity_) {
+      grow(words_ * 2 + 1);
+    }
+    std::memcpy(data_ + words_ * sizeof(word_type), &word, sizeof(word_type));
+    ++words_;
+  }
+
+  // grow the owned buffer to `words` words
+  void grow(size_type words) {
+    if (external_) {
+      throw std::length_error("bitwriter: the output buffer is too small");
+    }
+    storage_.resize(words);
+    data_ = reinterpret_cast<uint8_t*>(storage_.data());
+    capacity_ = storage_.size() * sizeof(word_type);
+  }
+
+  std::vector<word_type> storage_;  // owned buffer, if any
+  uint8_t* data_ = nullptr;         // underlying buffer
+  size_type capacity_ = 0;          // size of the underlying buffer, in bytes
+  bool external_ = false;           // the underlying buffer is provided by the caller
+  size_type words_ = 0;             // number of full words stored in the underlying buffer
+  size_type bits_ = 0;              // number of bits in `accumulator_`
+  word_type accumulator_ = 0;       // bits not yet stored in the underlying buffer
+};
+
+#endif  // bitwriter_h
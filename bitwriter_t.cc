@@ -0,0 +1,167 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bitstream.h"
+#include "bitwriter.h"
+
+int main(int argc, const char* argv[]) {
+  {
+    // write "42" one bit at a time, followed by 60 bits out of a 64-bit word
+    bitwriter stream;
+    stream.write(false);
+    stream.write(true);
+    stream.write(false);
+    stream.write(true);
+    stream.write(false);
+    stream.write(true);
+    stream.write(false);
+    stream.write(false);
+    uint64_t value = 0b1100'00001010'00011110'01011100'11101101'11001010'10110001'11100101;
+    stream.write(60, value);
+    stream.flush();
+
+    const uint8_t expected[] = {0b00101010, 0b11100101, 0b10110001, 0b11001010, 0b11101101, 0b01011100, 0b00011110, 0b00001010, 0b1100};
+    std::cout << "written " << stream.size() << " bits in " << stream.bytes() << " bytes" << std::endl;
+    assert(stream.size() == 68);
+    assert(stream.bytes() == sizeof(expected));
+    assert(std::memcmp(stream.data(), expected, sizeof(expected)) == 0);
+  }
+
+  {
+    // write a random sequence of values of random lengths, and compare with the results of a bitstream
+    std::mt19937_64 random(42);
+    bitstream reference;
+    bitwriter stream;
+    for (int i = 0; i < 100000; ++i) {
+      unsigned int count = random() % 65;
+      uint64_t value = random();
+      if (count < 64) {
+        value &= (1ul << count) - 1;
+      }
+      reference.write(count, value);
+      stream.write(count, value);
+    }
+    stream.flush();
+
+    std::vector<uint8_t> expected = reference.bytes();
+    std::cout << "written " << stream.size() << " bits in " << stream.bytes() << " bytes" << std::endl;
+    assert(stream.size() == reference.size());
+    assert(stream.bytes() == expected.size());
+    assert(std::memcmp(stream.data(), expected.data(), expected.size()) == 0);
+
+    // write the same sequence to a caller-provided buffer of the exact size, followed by a guard byte
+    std::vector<uint8_t> buffer(expected.size() + 1, 0xff);
+    bitwriter external(buffer.data(), expected.size());
+    random.seed(42);
+    for (int i = 0; i < 100000; ++i) {
+      unsigned int count = random() % 65;
+      uint64_t value = random();
+      if (count < 64) {
+        value &= (1ul << count) - 1;
+      }
+      external.write(count, value);
+    }
+    external.flush();
+    std::cout << "written " << external.size() << " bits in " << external.bytes() << " bytes to an external buffer" << std::endl;
+    assert(external.data() == buffer.data());
+    assert(std::memcmp(buffer.data(), expected.data(), expected.size()) == 0);
+    assert(buffer.back() == 0xff);
+
+    // writing past the end of the external buffer fails
+    bool failed = false;
+    try {
+      external.write(64, ~0ul);
+      external.flush();
+    } catch (std::length_error const&) {
+      failed = true;
+    }
+    assert(failed);
+  }
+  {
+    // copy whole bytes at every byte offset within a word, and compare with the same bytes written one by one
+    std::vector<uint8_t> bytes(1001);
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      bytes[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    for (unsigned int offset = 0; offset <= 64; offset += 8) {
+      for (size_t size : {0ul, 1ul, 7ul, 8ul, 1001ul}) {
+        bitwriter reference;
+        bitwriter stream;
+        reference.write(offset, 0x5555555555555555ul);
+        stream.write(offset, 0x5555555555555555ul);
+        for (size_t i = 0; i < size; ++i) {
+          reference.write(8, bytes[i]);
+        }
+        stream.write_bytes(bytes.data(), size);
+        reference.write(13, 0x1abc);
+        stream.write(13, 0x1abc);
+        reference.flush();
+        stream.flush();
+        assert(stream.size() == reference.size());
+        assert(std::memcmp(stream.data(), reference.data(), reference.bytes()) == 0);
+      }
+    }
+    std::cout << "copied whole bytes at every byte offset" << std::endl;
+  }
+  {
+    // write sequences of codes with the bulk kernel, and compare with the results of single writes, for codes that are stored
+    // two at a time, one at a time, or that are too long for the kernel
+    std::mt19937_64 random(42);
+    for (unsigned int max_length : {15u, 28u, 29u, 56u, 57u, 64u}) {
+      uint64_t codes[256];
+      uint8_t lengths[256];
+      for (int symbol = 0; symbol < 256; ++symbol) {
+        lengths[symbol] = 1 + random() % max_length;
+        codes[symbol] = lengths[symbol] < 64 ? random() & ((1ul << lengths[symbol]) - 1) : random();
+      }
+      std::vector<uint8_t> symbols(10001);
+      for (auto& symbol : symbols) {
+        symbol = random();
+      }
+      for (unsigned int offset : {0u, 5u, 63u}) {
+        bitwriter reference;
+        bitwriter stream;
+        reference.write(offset, 0x5555555555555555ul);
+        stream.write(offset, 0x5555555555555555ul);
+        for (uint8_t symbol : symbols) {
+          reference.write(lengths[symbol], codes[symbol]);
+        }
+        reference.write(7, 0x55);
+        stream.write_codes(symbols.data(), 0, codes, lengths, 0);
+        stream.write_codes(symbols.data(), symbols.size(), codes, lengths, max_length);
+        stream.write(7, 0x55);
+        reference.flush();
+        stream.flush();
+        assert(stream.size() == reference.size());
+        assert(std::memcmp(stream.data(), reference.data(), reference.bytes()) == 0);
+
+        // the same codes in a caller-provided buffer of the exact size, followed by a guard byte
+        std::vector<uint8_t> buffer(reference.bytes() + 1, 0xff);
+        bitwriter external(buffer.data(), reference.bytes());
+        external.write(offset, 0x5555555555555555ul);
+        external.write_codes(symbols.data(), symbols.size(), codes, lengths, max_length);
+        external.write(7, 0x55);
+        external.flush();
+        assert(std::memcmp(buffer.data(), reference.data(), reference.bytes()) == 0);
+        assert(buffer.back() == 0xff);
+
+        // the same codes written to a separate stream, and appended after the first bits
+        bitwriter codes_only;
+        codes_only.write_codes(symbols.data(), symbols.size(), codes, lengths, max_length);
+        codes_only.flush();
+        bitwriter appended;
+        appended.write(offset, 0x5555555555555555ul);
+        appended.append(codes_only);
+        appended.write(7, 0x55);
+        appended.flush();
+        assert(appended.size() == reference.size());
+        assert(std::memcmp(appended.data(), reference.data(), reference.bytes()) == 0);
+      }
+      std::cout << "written " << symbols.size() << " codes of up to " << max_length << " bits in bulk" << std::endl;
+    }
+  }
+}
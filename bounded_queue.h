@@ -0,0 +1,76 @@
+#ifndef bounded_queue_h
+#define bounded_queue_h
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/* FIFO queue of a bounded capacity, that connects the stages of a pipeline running in different threads
+ *
+ * push() waits while the queue is full, and pop() waits while it is empty, so that a fast stage cannot run ahead of a slow one by
+ * more than the capacity of the queue. Closing the queue wakes up all the waiting threads: the items already in the queue can
+ * still be popped, but any further push fails, so that a stage can stop its producer after an error.
+ */
+
+template <typename T>
+class bounded_queue {
+public:
+  // construct a queue that holds at most `capacity` items
+  explicit bounded_queue(size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {}
+
+  bounded_queue(bounded_queue const&) = delete;
+  bounded_queue& operator=(bounded_queue const&) = delete;
+
+  // append `item` to the queue, waiting while it is full; return false if the queue has been closed, and the item dropped
+  bool push(T item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_full_.wait(lock, [this] { return closed_ or items_.size() < capacity_; });
+      if (closed_) {
+        return false;
+      }
+      items_.push_back(std::move(item));
+    }
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // remove the first item of the queue, waiting while it is empty; return nothing once the queue is closed and empty
+  std::optional<T> pop() {
+    std::optional<T> item;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_.wait(lock, [this] { return closed_ or not items_.empty(); });
+      if (items_.empty()) {
+        return item;
+      }
+      item.emplace(std::move(items_.front()));
+      items_.pop_front();
+    }
+    not_full_.notify_one();
+    return item;
+  }
+
+  // close the queue: no more items can be pushed, and the waiting threads are woken up
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  bool closed_ = false;
+};
+
+#endif  // bounded_queue_h
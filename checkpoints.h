@@ -0,0 +1,165 @@
+#ifndef checkpoints_h
+#define checkpoints_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include "bitreader.h"
+#include "histogram.h"
+#include "huffman.h"
+#include "thread_pool.h"
+
+/* checkpoints of a single-table stream, for parallel decoding
+ *
+ * A single-table stream is one long sequence of encodings, that can only be decoded from its beginning. The encoder can record a
+ * checkpoint every `interval` symbols: the position of the encoding of that symbol in the stream, so that several decoders can
+ * start from different checkpoints and decode disjoint parts of the message at the same time. A stream with checkpoints holds:
+ *
+ *   64 bit:            `marker`, that cannot be the message size of a full header nor the marker of a compact header
+ *                      the serialised canonical Huffman coding, with the full or the compact header
+ *   64 bit:            number of symbols between two checkpoints K
+ *   N x 64 bit:        for each checkpoint, the offset (in bits) of the encoding of symbol (i + 1) x K from the beginning of the
+ *                      encoded message; there are N = (original size - 1) / K checkpoints, and none for an empty message
+ *                      the encoded message
+ *
+ * The encoded message starts right after the checkpoints, and the size stored in the header of the coding does not include them.
+ * The offsets are known before encoding the message, from the lengths of the encodings: the symbols between two checkpoints are
+ * counted in parallel, and the offsets are the cumulative sums of their encoded sizes.
+ */
+
+namespace checkpoints {
+
+  constexpr uint64_t marker = 2;
+  constexpr uint64_t default_interval = uint64_t(1) << 20;  // number of symbols between two checkpoints (default: 1M)
+
+  // number of checkpoints of a message of `size` symbols, with a checkpoint every `interval` symbols
+  inline uint64_t count(uint64_t size, uint64_t interval) { return size == 0 ? 0 : (size - 1) / interval; }
+
+  // size (in bits) of the marker and of the checkpoints of a message of `size` symbols, in addition to the coding
+  inline uint64_t overhead(uint64_t size, uint64_t interval) { return 64 + 64 + 64 * count(size, interval); }
+
+  // return true if the `size` bytes of `data` start with the marker of a stream with checkpoints
+  inline bool has_checkpoints(uint8_t const* data, size_t size) {
+    uint64_t value = 0;
+    if (size < sizeof(value)) {
+      return false;
+    }
+    std::memcpy(&value, data, sizeof(value));
+    return value == marker;
+  }
+
+  // number of bits used by the encodings of the `size` symbols of `data`
+  template <typename Encoding>
+  uint64_t encoded_size(Encoding const& encoding, typename Encoding::alphabet_type const* data, size_t size) {
+    uint64_t bits = 0;
+    if constexpr (Encoding::alphabet_size <= 256) {
+      // small alphabets are counted first, with the fast histogram kernel
+      uint64_t weights[256] = {};
+      histogram(data, size, weights);
+      for (int symbol = 0; symbol < Encoding::alphabet_size; ++symbol) {
+        bits += weights[symbol] * encoding.lengths_[symbol];
+      }
+    } else {
+      for (size_t i = 0; i < size; ++i) {
+        bits += encoding.lengths_[data[i]];
+      }
+    }
+    return bits;
+  }
+
+  // offsets (in bits, from the beginning of the encoded message) of the checkpoints of the `size` symbols of `data`, encoded with
+  // `encoding`, with a checkpoint every `interval` symbols; the parts between two checkpoints are counted by the threads of `pool`
+  template <typename Encoding>
+  std::vector<uint64_t> offsets(Encoding const& encoding, typename Encoding::alphabet_type const* data, size_t size, uint64_t interval,
+                                thread_pool& pool) {
+    std::vector<std::future<uint64_t>> sizes;
+    for (uint64_t i = 0; i < count(size, interval); ++i) {
+      sizes.push_back(pool.submit([&encoding, part = data + i * interval, interval]() { return encoded_size(encoding, part, interval); }));
+    }
+    std::vector<uint64_t> offsets;
+    offsets.reserve(sizes.size());
+    uint64_t offset = 0;
+    for (auto& bits : sizes) {
+      offset += bits.get();
+      offsets.push_back(offset);
+    }
+    return offsets;
+  }
+
+  // write the marker of a stream with checkpoints to a bit stream, before the canonical Huffman coding
+  template <typename Stream>
+  void write_marker(Stream& stream) {
+    stream.write(64, marker);
+  }
+
+  // write the checkpoints after the canonical Huffman coding, with one checkpoint every `interval` symbols at `offsets`
+  template <typename Stream>
+  void write(Stream& stream, uint64_t interval, std::vector<uint64_t> const& offsets) {
+    stream.write(64, interval);
+    for (uint64_t offset : offsets) {
+      stream.write(64, offset);
+    }
+  }
+
+  // read the checkpoints of the message encoded with `encoding` from a bit stream, after the canonical Huffman coding; return
+  // false if they are not consistent with the coding
+  template <typename Encoding>
+  bool read(bitreader& stream, Encoding const& encoding, uint64_t& interval, std::vector<uint64_t>& offsets) {
+    interval = 0;
+    if (stream.read(64, interval) != 64 or interval == 0) {
+      return false;
+    }
+    uint64_t checkpoints = count(encoding.original_size_, interval);
+    if (checkpoints > (stream.size() - stream.tellg()) / 64) {
+      return false;
+    }
+    offsets.resize(checkpoints);
+    uint64_t previous = 0;
+    for (auto& offset : offsets) {
+      stream.read(64, offset);
+      if (offset < previous or offset > encoding.encoded_size_) {
+        return false;
+      }
+      previous = offset;
+    }
+    return true;
+  }
+
+  // decode the `size` symbols of the message that starts at the read pointer of `stream` into `out`, starting from each checkpoint
+  // in a separate task of `pool`; return the number of symbols decoded (from the beginning of the message) before the first error
+  template <typename Decoder>
+  size_t decode(bitreader const& stream, Decoder const& decoder, uint64_t interval, std::vector<uint64_t> const& offsets,
+                typename Decoder::alphabet_type* out, size_t size, thread_pool& pool) {
+    uint64_t begin = stream.tellg();
+    std::vector<std::future<bool>> parts;
+    for (uint64_t i = 0; i <= offsets.size(); ++i) {
+      parts.push_back(pool.submit([&, i]() {
+        uint64_t first = i * interval;
+        uint64_t count = std::min<uint64_t>(interval, size - first);
+        bitreader part = stream;
+        part.seekg(begin + (i == 0 ? 0 : offsets[i - 1]));
+        // the encoding of the last symbol of each part must end exactly at the next checkpoint
+        return decoder.decode(part, out + first, count) == count and (i == offsets.size() or part.tellg() == begin + offsets[i]);
+      }));
+    }
+    size_t decoded = 0;
+    for (uint64_t i = 0; i < parts.size(); ++i) {
+      if (not parts[i].get()) {
+        // wait for the other parts, that still write to the output
+        for (++i; i < parts.size(); ++i) {
+          parts[i].wait();
+        }
+        break;
+      }
+      decoded = std::min<uint64_t>((i + 1) * interval, size);
+    }
+    return decoded;
+  }
+
+}  // namespace checkpoints
+
+#endif  // checkpoints_h
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "checkpoints.h"
+#include "decoder.h"
+#include "huffman.h"
+#include "thread_pool.h"
+
+int main(int argc, const char* argv[]) {
+  // a skewed message, with runs of the same symbol
+  std::mt19937 random(42);
+  std::geometric_distribution<int> symbols(0.2);
+  std::vector<uint8_t> message;
+  while (message.size() < 100000) {
+    message.insert(message.end(), random() % 8 == 0 ? random() % 40 : 1, std::min(symbols(random), 255));
+  }
+
+  thread_pool pool(3);
+  for (uint64_t interval : {uint64_t(1), uint64_t(7), uint64_t(4096), uint64_t(99999), uint64_t(100000), checkpoints::default_interval}) {
+    for (size_t size : {size_t(0), size_t(1), size_t(4096), message.size()}) {
+      huffman_encoding encoding;
+      encoding.scan_input(message.data(), size);
+      encoding.build_from_weights(15);
+      encoding.use_compact_header();
+
+      // the offsets of the checkpoints are the encoded sizes of the symbols before them
+      std::vector<uint64_t> offsets = checkpoints::offsets(encoding, message.data(), size, interval, pool);
+      size_t count = checkpoints::count(size, interval);
+      assert(offsets.size() == count);
+      for (size_t i = 0; i < offsets.size(); ++i) {
+        uint64_t encoded_size = checkpoints::encoded_size(encoding, message.data(), (i + 1) * interval);
+        assert(offsets[i] == encoded_size);
+      }
+
+      bitwriter writer;
+      checkpoints::write_marker(writer);
+      encoding.serialise(writer);
+      checkpoints::write(writer, interval, offsets);
+      uint64_t message_begin = writer.size();
+      uint64_t overhead = checkpoints::overhead(size, interval);
+      assert(message_begin == overhead + encoding.header_size_);
+      encoding.encode(message.data(), size, writer);
+      assert(writer.size() == message_begin + encoding.encoded_size_);
+      writer.flush();
+      bool checkpointed = checkpoints::has_checkpoints(writer.data(), writer.bytes());
+      assert(checkpointed);
+
+      // read the coding and the checkpoints back
+      bitreader reader(writer.data(), writer.bytes() * 8);
+      reader.skip(64);
+      huffman_encoding decoded_encoding;
+      bool deserialised = decoded_encoding.deserialise(reader);
+      assert(deserialised);
+      uint64_t decoded_interval;
+      std::vector<uint64_t> decoded_offsets;
+      bool read = checkpoints::read(reader, decoded_encoding, decoded_interval, decoded_offsets);
+      assert(read);
+      assert(decoded_interval == interval and decoded_offsets == offsets);
+      assert(reader.tellg() == message_begin);
+      reader.truncate(message_begin + decoded_encoding.encoded_size_);
+
+      // decode the parts between the checkpoints in parallel, with both kinds of tables
+      for (auto type : {huffman_decoder::table_type::single_symbol, huffman_decoder::table_type::multi_symbol}) {
+        huffman_decoder decoder(decoded_encoding, huffman_decoder::default_table_bits, type);
+        std::vector<uint8_t> decoded(size);
+        size_t decoded_size = checkpoints::decode(reader, decoder, interval, offsets, decoded.data(), size, pool);
+        assert(decoded_size == size);
+        assert(std::equal(decoded.begin(), decoded.end(), message.begin()));
+      }
+
+      // a checkpoint that does not match the encodings is detected
+      if (offsets.size() > 1) {
+        huffman_decoder decoder(decoded_encoding);
+        std::vector<uint8_t> decoded(size);
+        std::vector<uint64_t> shifted = offsets;
+        ++shifted.back();
+        size_t decoded_size = checkpoints::decode(reader, decoder, interval, shifted, decoded.data(), size, pool);
+        assert(decoded_size == (shifted.size() - 1) * interval);
+      }
+    }
+    std::cout << "checkpoints every " << interval << " symbols: "
+              << checkpoints::count(message.size(), interval) << " checkpoints for " << message.size() << " symbols" << std::endl;
+  }
+
+  // a stream without checkpoints starts with the size of the message, or the marker of the compact header
+  uint8_t full[8] = {0x90, 0x06};
+  uint8_t compact[8] = {huffman_encoding::compact_marker};
+  bool checkpointed = checkpoints::has_checkpoints(full, sizeof(full));
+  assert(not checkpointed);
+  checkpointed = checkpoints::has_checkpoints(compact, sizeof(compact));
+  assert(not checkpointed);
+  checkpointed = checkpoints::has_checkpoints(compact, 4);
+  assert(not checkpointed);
+}
@@ -0,0 +1,101 @@
+#ifndef codec_h
+#define codec_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bitwriter.h"
+#include "container.h"
+#include "decoder.h"
+#include "huffman.h"
+
+/* reusable context to compress and decompress many small messages
+ *
+ * Each message is compressed as a single block of the container format (see container.h), without the container header and the
+ * end of stream marker: a Huffman block with its own coding, a stored block, or a single-symbol block, whichever is the smallest.
+ * The compressed message is thus never larger than max_compressed_size() of the original one.
+ *
+ * The context holds the coding and the decoding tables, that are rebuilt in place for each message, and writes directly into the
+ * buffers of the caller: the coding and its scratch space are fixed-size arrays, and the decoding tables keep their memory from
+ * one message to the next, so that once the tables have been allocated by the first decompressed message, compressing and
+ * decompressing do not allocate any memory.
+ *
+ * A context is not thread-safe; local() gives each thread its own context, with the default configuration.
+ */
+
+class codec {
+public:
+  static constexpr int default_max_length = 15;
+
+  // construct a context that compresses with encodings of at most `max_length` bits, and decompresses with tables indexed by
+  // `table_bits` bits; building the single-symbol table is much cheaper than the multi-symbol one, which matters for small
+  // messages
+  explicit codec(int max_length = default_max_length, int table_bits = huffman_decoder::default_table_bits,
+                 huffman_decoder::table_type type = huffman_decoder::table_type::single_symbol)
+      : max_length_(max_length), decoder_(table_bits, type) {}
+
+  codec(codec const&) = delete;
+  codec& operator=(codec const&) = delete;
+
+  // the context of the calling thread
+  static codec& local() {
+    thread_local codec context;
+    return context;
+  }
+
+  // largest size of a message of `size` bytes once compressed: a stored block is never larger than its header and the message
+  static constexpr size_t max_compressed_size(size_t size) { return container::block_header_size + size; }
+
+  // size of the message compressed in the first `size` bytes of `src` once decompressed, or 0 if `src` is too short to tell
+  static size_t decompressed_size(uint8_t const* src, size_t size) {
+    return size < container::block_header_size ? 0 : container::read_block_header(src).symbols;
+  }
+
+  // compress the `size` bytes of `src` into the `capacity` bytes of `dst`, and set `written` to the size of the compressed
+  // message; return false if `capacity` is smaller than max_compressed_size(size)
+  bool compress(uint8_t const* src, size_t size, uint8_t* dst, size_t capacity, size_t& written) {
+    if (capacity < max_compressed_size(size)) {
+      return false;
+    }
+    encoding_ = huffman_encoding();
+    encoding_.scan_input(src, size);
+    container::block_type type = container::screen_block_type(encoding_, nullptr);
+    if (type == container::block_type::huffman) {
+      encoding_.build_from_weights(max_length_);
+      encoding_.use_compact_header();
+      type = container::choose_block_type(encoding_, nullptr);
+    }
+    bitwriter out(dst, capacity);
+    container::encode_block(src, size, type, &encoding_, out);
+    out.flush();
+    written = out.bytes();
+    return true;
+  }
+
+  // decompress the message compressed in the `size` bytes of `src` into the `capacity` bytes of `dst`, and set `decoded` to its
+  // size; return false if the message is corrupted, or if it does not fit in `dst`
+  bool decompress(uint8_t const* src, size_t size, uint8_t* dst, size_t capacity, size_t& decoded) {
+    if (size < container::block_header_size) {
+      return false;
+    }
+    container::block_header header = container::read_block_header(src);
+    // a message does not reference any other block, nor a pre-trained coding
+    if (header.type == container::block_type::end_of_stream or header.type == container::block_type::huffman_repeat or
+        header.type == container::block_type::huffman_dictionary) {
+      return false;
+    }
+    if (header.payload_size > size - container::block_header_size or header.symbols > capacity or
+        not container::decode_block(header, src + container::block_header_size, dst, decoder_)) {
+      return false;
+    }
+    decoded = header.symbols;
+    return true;
+  }
+
+private:
+  int max_length_;
+  huffman_encoding encoding_;  // coding of the last compressed message
+  huffman_decoder decoder_;    // decoding tables of the last decompressed message
+};
+
+#endif  // codec_h
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "codec.h"
+
+// count the allocations, to check that the context does not allocate any memory once it has been used
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+  ++allocations;
+  if (void* ptr = std::malloc(size ? size : 1)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+int main(int argc, const char* argv[]) {
+  // small messages of all kinds: empty, a single symbol, text, random bytes
+  std::mt19937 random(42);
+  std::vector<std::string> messages = {std::string(), std::string("a"), std::string(300, 'z'), std::string("\x00\x01", 2)};
+  for (int i = 0; i < 100; ++i) {
+    std::string message;
+    while (message.size() < size_t(i * 37)) {
+      message += i % 3 ? "GET /index.html HTTP/1.1 " + std::to_string(random() % 1000) + "\n" : std::string(1, char(random()));
+    }
+    messages.push_back(message);
+  }
+  size_t largest = 0;
+  for (auto const& message : messages) {
+    largest = std::max(largest, message.size());
+  }
+  std::vector<uint8_t> compressed(codec::max_compressed_size(largest));
+  std::vector<uint8_t> decompressed(largest);
+
+  codec context;
+  size_t original = 0, total = 0;
+  for (int round = 0; round < 3; ++round) {
+    // the decoding tables are allocated by the first round; the next ones do not allocate any memory
+    size_t before = allocations;
+    for (auto const& message : messages) {
+      uint8_t const* data = reinterpret_cast<uint8_t const*>(message.data());
+      size_t written = 0, decoded = 0;
+      bool compressed_ok = context.compress(data, message.size(), compressed.data(), compressed.size(), written);
+      assert(compressed_ok and written <= codec::max_compressed_size(message.size()));
+      size_t size = codec::decompressed_size(compressed.data(), written);
+      assert(size == message.size());
+      bool decompressed_ok = context.decompress(compressed.data(), written, decompressed.data(), decompressed.size(), decoded);
+      assert(decompressed_ok);
+      assert(decoded == message.size() and std::equal(data, data + message.size(), decompressed.begin()));
+      if (round == 0) {
+        original += message.size();
+        total += written;
+
+        // a truncated message, or a buffer that is too small, are rejected
+        decompressed_ok = context.decompress(compressed.data(), written - 1, decompressed.data(), decompressed.size(), decoded);
+        assert(not decompressed_ok);
+        if (message.size() > 0) {
+          decompressed_ok = context.decompress(compressed.data(), written, decompressed.data(), message.size() - 1, decoded);
+          assert(not decompressed_ok);
+        }
+        compressed_ok = context.compress(data, message.size(), compressed.data(), codec::max_compressed_size(message.size()) - 1, written);
+        assert(not compressed_ok);
+      }
+    }
+    assert(round == 0 or allocations == before);
+  }
+  std::cout << messages.size() << " messages of " << original << " bytes compressed to " << total << " bytes" << std::endl;
+
+  // each thread has its own context
+  codec* main_context = &codec::local();
+  codec* same_context = &codec::local();
+  assert(same_context == main_context);
+  codec* thread_context = nullptr;
+  std::thread([&thread_context] { thread_context = &codec::local(); }).join();
+  assert(thread_context != main_context);
+}
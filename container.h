@@ -0,0 +1,745 @@
+#ifndef container_h
+#define container_h
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "decoder.h"
+#include "dictionary.h"
+#include "huffman.h"
+#include "tans.h"
+
+/* block-based container format
+ *
+ * The input is split into blocks of up to `block_size` symbols, each with its own canonical Huffman coding or reusing the coding
+ * of the previous one, so that the encoder and the decoder only need to hold one block in memory at a time:
+ *
+ *   container header:  8 bytes   magic number: "wither" 0x01 0xff
+ *                      8 bytes   maximum number of symbols in a block
+ *   block header:      1 byte    block type
+ *                      7 bytes   size of the block payload, in bytes
+ *                      8 bytes   number of symbols in the block
+ *   block payload:               the serialised canonical Huffman coding, with the compact header when it is smaller,
+ *                                followed by the encoded symbols and padded to a whole number of bytes
+ *   ...
+ *   end of stream:     a block header of type `end_of_stream`, with no payload and no symbols
+ *
+ * The payload of an interleaved block splits the symbols into N consecutive segments of ceil(symbols / N) symbols (the last one
+ * may be shorter), each encoded as a separate stream with the same coding, so that the decoder can work on several independent
+ * streams at the same time:
+ *
+ *   interleaved payload:         the serialised canonical Huffman coding, padded to a whole number of bytes
+ *                      1 byte    number of streams N
+ *                      N x 8 bytes  size of each stream, in bytes
+ *                                the N streams, each padded to a whole number of bytes
+ *
+ * The payload of a dictionary block does not include the coding, but references a pre-trained one (see dictionary.h):
+ *
+ *   dictionary payload:  8 bytes   identifier of the dictionary
+ *                                  the encoded symbols, padded to a whole number of bytes
+ *
+ * The payload of a repeat block does not include the coding either, but reuses the coding of the last block that carried one, so
+ * that the decoder does not need to rebuild its tables; the symbols are split into streams as in an interleaved block:
+ *
+ *   repeat payload:      1 byte    number of streams N
+ *                        N x 8 bytes  size of each stream, in bytes
+ *                                  the N streams, each padded to a whole number of bytes
+ *
+ * The payload of a tANS block holds a tANS coding instead of a canonical Huffman one (see tans.h), for the blocks where the
+ * fractional bits of its encodings make it smaller, e.g. on skewed data where the most frequent symbol has a probability above 1/2:
+ *
+ *   tans payload:                the serialised tANS coding, followed by the encoded symbols and padded to a whole number of bytes
+ *
+ * The payload of a stored block is the symbols themselves, for the blocks that would not be any smaller when encoded, and the
+ * payload of a single-symbol block is the one symbol that is repeated `symbols` times.
+ *
+ * The end of stream marker may be followed by an index of the blocks, for random access, that ends with a fixed-size trailer so
+ * that it can be found from the end of the container:
+ *
+ *   index:             N x 24 bytes  for each block: the position of its first symbol in the decoded stream, the offset of its
+ *                                    header in the container, and the offset of the header of the last block that carried a
+ *                                    coding up to this one (or 2^64 - 1 if there is none), in bytes
+ *   index trailer:     8 bytes   number of blocks N
+ *                      8 bytes   magic number: "wither" 0x03 0xff
+ *
+ * All the fields are little endian. Read as a 64-bit little endian value, the magic number would be the size of a single-table
+ * message of more than 2^63 bits, so the container cannot be mistaken for the beginning of a single-table stream.
+ */
+
+namespace container {
+
+  constexpr uint8_t magic[8] = {'w', 'i', 't', 'h', 'e', 'r', 0x01, 0xff};
+  constexpr uint8_t index_magic[8] = {'w', 'i', 't', 'h', 'e', 'r', 0x03, 0xff};
+
+  constexpr size_t header_size = 16;        // size of the container header, in bytes
+  constexpr size_t block_header_size = 16;  // size of a block header, in bytes
+  constexpr size_t index_entry_size = 24;   // size of an entry of the index, in bytes
+  constexpr size_t index_trailer_size = 16; // size of the trailer of the index, in bytes
+  constexpr uint64_t no_coding = UINT64_MAX; // offset of the coding of the blocks that are not preceded by any coding
+
+  constexpr uint64_t default_block_size = 1 << 20;        // 1 Mi symbols
+  constexpr uint64_t max_payload_size = (1ul << 56) - 1;  // largest payload that can be described by a block header
+  constexpr uint64_t max_block_size = 1ul << 52;          // largest block, whose encoded payload still fits in max_payload_size
+  constexpr int max_streams = 8;                          // largest number of streams in an interleaved block
+
+  enum class block_type : uint8_t {
+    end_of_stream = 0,  // end of the stream
+    huffman = 1,        // canonical Huffman coding and encoded symbols
+    huffman_interleaved = 2,  // canonical Huffman coding and several streams of encoded symbols
+    huffman_dictionary = 3,   // identifier of a pre-trained coding and encoded symbols
+    huffman_repeat = 4,       // several streams of symbols encoded with the coding of the last block that carried one
+    stored = 5,               // symbols stored as they are
+    single_symbol = 6,        // one symbol, repeated for the whole block
+    tans = 7                  // tANS coding and encoded symbols
+  };
+
+  // true for the blocks that carry a coding, whose decoding tables are used by the next repeat blocks
+  inline bool carries_coding(block_type type) { return type == block_type::huffman or type == block_type::huffman_interleaved; }
+
+  struct block_header {
+    block_type type = block_type::end_of_stream;
+    uint64_t payload_size = 0;  // size of the block payload, in bytes
+    uint64_t symbols = 0;       // number of symbols in the block
+  };
+
+  // check if the first `size` bytes of `data` start with a container header
+  inline bool is_container(uint8_t const* data, size_t size) {
+    return size >= sizeof(magic) and std::memcmp(data, magic, sizeof(magic)) == 0;
+  }
+
+  // write the container header
+  inline void write_header(bitwriter& out, uint64_t block_size) {
+    assert(out.size() % 8 == 0);
+    for (uint8_t byte : magic) {
+      out.write(8, byte);
+    }
+    out.write(64, block_size);
+  }
+
+  // read the block size from a container header of `header_size` bytes; return false if it is zero or larger than max_block_size
+  inline bool read_header(uint8_t const* data, uint64_t& block_size) {
+    assert(is_container(data, header_size));
+    std::memcpy(&block_size, data + sizeof(magic), sizeof(block_size));
+    return block_size > 0 and block_size <= max_block_size;
+  }
+
+  // write a block header
+  inline void write_block_header(bitwriter& out, block_header const& header) {
+    assert(out.size() % 8 == 0);
+    assert(header.payload_size <= max_payload_size);
+    out.write(8, static_cast<uint8_t>(header.type));
+    out.write(56, header.payload_size);
+    out.write(64, header.symbols);
+  }
+
+  // read a block header of `block_header_size` bytes
+  inline block_header read_block_header(uint8_t const* data) {
+    bitreader in(data, block_header_size * 8);
+    block_header header;
+    uint8_t type;
+    in.read(8, type);
+    header.type = static_cast<block_type>(type);
+    in.read(56, header.payload_size);
+    in.read(64, header.symbols);
+    return header;
+  }
+
+  // pad the stream with zeroes up to a whole number of bytes
+  inline void align(bitwriter& out) { out.write((8 - out.size() % 8) % 8, 0); }
+
+  // number of symbols in each segment of an interleaved block of `size` symbols, split into `streams` streams
+  inline uint64_t segment_size(uint64_t size, int streams) { return (size + streams - 1) / streams; }
+
+  // compute into `stream_bytes` the size in bytes of each of the `streams` streams of the `size` symbols from `data` encoded with
+  // `encoding`, and return the size of the part of the payload written by write_streams()
+  inline uint64_t measure_streams(huffman_encoding::alphabet_type const* data, size_t size, huffman_encoding const& encoding, int streams, uint64_t* stream_bytes) {
+    uint64_t segment = segment_size(size, streams);
+    uint64_t total = 1 + 8 * streams;
+    for (int k = 0; k < streams; ++k) {
+      uint64_t bits = 0;
+      for (size_t i = std::min(k * segment, size); i < std::min((k + 1) * segment, size); ++i) {
+        bits += encoding.lengths_[data[i]];
+      }
+      stream_bytes[k] = (bits + 7) / 8;
+      total += stream_bytes[k];
+    }
+    return total;
+  }
+
+  // write the number of streams, their sizes `stream_bytes` computed by measure_streams(), and the `streams` streams of the `size`
+  // symbols from `data` encoded with `encoding`
+  inline void write_streams(huffman_encoding::alphabet_type const* data, size_t size, huffman_encoding const& encoding, int streams, uint64_t const* stream_bytes,
+                            bitwriter& out) {
+    uint64_t segment = segment_size(size, streams);
+    out.write(8, streams);
+    for (int k = 0; k < streams; ++k) {
+      out.write(64, stream_bytes[k]);
+    }
+    for (int k = 0; k < streams; ++k) {
+      size_t begin = std::min(k * segment, size);
+      encoding.encode(data + begin, std::min((k + 1) * segment, size) - begin, out);
+      align(out);
+    }
+  }
+
+  // encode `size` symbols from `data` as a block with the coding `encoding` built from them, and append it to `out`; with
+  // more than one stream, the symbols are split into `streams` interleaved streams
+  inline void encode_block(huffman_encoding::alphabet_type const* data, size_t size, huffman_encoding const& encoding, bitwriter& out, int streams) {
+    assert(streams >= 1 and streams <= max_streams);
+    if (streams == 1) {
+      uint64_t payload_bits = encoding.header_size_ + encoding.encoded_size_;
+      out.reserve(out.size() + block_header_size * 8 + payload_bits);
+      write_block_header(out, {block_type::huffman, (payload_bits + 7) / 8, size});
+      encoding.serialise(out);
+      encoding.encode(data, size, out);
+      align(out);
+      return;
+    }
+
+    uint64_t stream_bytes[max_streams];
+    uint64_t payload_bytes = (encoding.header_size_ + 7) / 8 + measure_streams(data, size, encoding, streams, stream_bytes);
+    out.reserve(out.size() + (block_header_size + payload_bytes) * 8);
+    write_block_header(out, {block_type::huffman_interleaved, payload_bytes, size});
+    encoding.serialise(out);
+    align(out);
+    write_streams(data, size, encoding, streams, stream_bytes, out);
+  }
+
+  // encode `size` symbols from `data` as a block of `streams` streams, with encodings of at most `max_length` bits, and append it
+  // to `out`
+  inline void encode_block(huffman_encoding::alphabet_type const* data, size_t size, int max_length, bitwriter& out, int streams = 1) {
+    huffman_encoding encoding(data, size, max_length);
+    encoding.use_compact_header();
+    encode_block(data, size, encoding, out, streams);
+  }
+
+  // encode `size` symbols from `data` as a repeat block, split into `streams` streams, with `encoding`, the coding of the last
+  // block that carried one, and append it to `out`; `encoding` must have an encoding for each of the symbols
+  inline void encode_repeat_block(huffman_encoding::alphabet_type const* data, size_t size, huffman_encoding const& encoding, bitwriter& out, int streams = 1) {
+    assert(streams >= 1 and streams <= max_streams);
+    uint64_t stream_bytes[max_streams];
+    uint64_t payload_bytes = measure_streams(data, size, encoding, streams, stream_bytes);
+    out.reserve(out.size() + (block_header_size + payload_bytes) * 8);
+    write_block_header(out, {block_type::huffman_repeat, payload_bytes, size});
+    write_streams(data, size, encoding, streams, stream_bytes, out);
+  }
+
+  // encode `size` symbols from `data` as a block with the tANS coding `encoding` built from their weights, and append it to `out`
+  inline void encode_tans_block(huffman_encoding::alphabet_type const* data, size_t size, tans_encoding& encoding, bitwriter& out) {
+    encoding.encode(data, size);
+    uint64_t payload_bits = encoding.header_size_ + encoding.encoded_size_;
+    out.reserve(out.size() + block_header_size * 8 + payload_bits);
+    write_block_header(out, {block_type::tans, (payload_bits + 7) / 8, size});
+    encoding.serialise(out);
+    encoding.write(out);
+    align(out);
+  }
+
+  // encode `size` copies of `symbol` as a single-symbol block, and append it to `out`
+  inline void encode_single_symbol_block(huffman_encoding::alphabet_type symbol, size_t size, bitwriter& out) {
+    out.reserve(out.size() + (block_header_size + 1) * 8);
+    write_block_header(out, {block_type::single_symbol, 1, size});
+    out.write(8, symbol);
+  }
+
+  // store `size` symbols from `data` as they are in a block, and append it to `out`
+  inline void encode_stored_block(huffman_encoding::alphabet_type const* data, size_t size, bitwriter& out) {
+    out.reserve(out.size() + (block_header_size + size) * 8);
+    write_block_header(out, {block_type::stored, size, size});
+    out.write_bytes(data, size * sizeof(huffman_encoding::alphabet_type));
+  }
+
+  // size of the payload of a repeat block of `streams` streams, for the symbols whose weights are in `encoding` and the coding
+  // `previous` of the last block that carried one, ignoring the padding of the streams; UINT64_MAX if there is no such coding, or
+  // if it has no encoding for one of the symbols
+  inline uint64_t repeat_payload_size(huffman_encoding const& encoding, huffman_encoding const* previous, int streams) {
+    if (not previous) {
+      return UINT64_MAX;
+    }
+    uint64_t bits = 0;
+    for (int symbol = 0; symbol < huffman_encoding::alphabet_size; ++symbol) {
+      if (encoding.weights_[symbol] > 0 and previous->lengths_[symbol] == 0) {
+        return UINT64_MAX;
+      }
+      bits += encoding.weights_[symbol] * previous->lengths_[symbol];
+    }
+    return 1 + 8 * streams + (bits + 7) / 8;
+  }
+
+  // choose the type of a block from the weights of its symbols in `encoding`, before building their coding: a single-symbol block
+  // if the symbols are all the same, a stored block if it is not larger than a repeat block with the coding `previous` of the
+  // last block that carried one (if any) nor than any block with its own coding, or huffman if the coding has to be built for
+  // choose_block_type() to decide. The size of a block with its own coding is bounded by the entropy of the symbols, and by the
+  // smallest compact header: 80 bits for its marker and alphabet size, and at least one bit for the length of each symbol.
+  inline block_type screen_block_type(huffman_encoding const& encoding, huffman_encoding const* previous, int streams = 1) {
+    uint64_t size = encoding.original_size_;
+    double entropy_bits = 0;
+    int present = 0;
+    for (int symbol = 0; symbol < huffman_encoding::alphabet_size; ++symbol) {
+      uint64_t weight = encoding.weights_[symbol];
+      if (weight == size and size > 0) {
+        return block_type::single_symbol;
+      }
+      if (weight > 0) {
+        entropy_bits += weight * std::log2(static_cast<double>(size) / weight);
+        ++present;
+      }
+    }
+    double coding_bytes = (entropy_bits + 80 + present) / 8;
+    if (size <= coding_bytes and size < repeat_payload_size(encoding, previous, streams)) {
+      return block_type::stored;
+    }
+    return block_type::huffman;
+  }
+
+  // choose the type of the block with the smallest payload for the symbols whose coding is `encoding`, split into `streams`
+  // streams: a block with this coding, a repeat block with the coding `previous` of the last block that carried one (if any), a
+  // tANS block with the coding `tans` built from the same weights (if any), or a stored block; the estimates ignore the padding
+  // of the streams, and a tie is resolved in favour of the block that is the fastest to decode
+  inline block_type choose_block_type(huffman_encoding const& encoding, huffman_encoding const* previous, int streams = 1,
+                                      tans_encoding const* tans = nullptr) {
+    uint64_t size = encoding.original_size_;
+    uint64_t coding_bytes = streams == 1 ? (encoding.header_size_ + encoding.encoded_size_ + 7) / 8
+                                         : (encoding.header_size_ + 7) / 8 + 1 + 8 * streams + (encoding.encoded_size_ + 7) / 8;
+    uint64_t repeat_bytes = repeat_payload_size(encoding, previous, streams);
+    uint64_t tans_bytes = tans ? (tans->header_size_ + tans->encoded_size_ + 7) / 8 : UINT64_MAX;
+    if (tans_bytes < size and tans_bytes < coding_bytes and tans_bytes < repeat_bytes) {
+      return block_type::tans;
+    }
+    if (repeat_bytes <= size and repeat_bytes <= coding_bytes) {
+      return block_type::huffman_repeat;
+    }
+    if (size <= coding_bytes) {
+      return block_type::stored;
+    }
+    return streams == 1 ? block_type::huffman : block_type::huffman_interleaved;
+  }
+
+  // encode `size` symbols from `data` as a block of type `type`, chosen by screen_block_type() or choose_block_type(), and append
+  // it to `out`; `encoding` is the coding of the block, or the coding of the last block that carried one for a repeat block, and
+  // is not used by a stored, single-symbol or tANS block; `tans` is the coding of a tANS block
+  inline void encode_block(huffman_encoding::alphabet_type const* data, size_t size, block_type type, huffman_encoding const* encoding, bitwriter& out,
+                           int streams = 1, tans_encoding* tans = nullptr) {
+    switch (type) {
+      case block_type::tans: encode_tans_block(data, size, *tans, out); break;
+      case block_type::huffman_repeat: encode_repeat_block(data, size, *encoding, out, streams); break;
+      case block_type::stored: encode_stored_block(data, size, out); break;
+      case block_type::single_symbol: encode_single_symbol_block(data[0], size, out); break;
+      default: encode_block(data, size, *encoding, out, streams); break;
+    }
+  }
+
+  // encoder of a sequence of blocks, that reuses the coding of the last block that carried one, stores the symbols as they are,
+  // or stores a single symbol, when the block is smaller; the coding of a block is only built if the weights of its symbols
+  // cannot rule it out, and a tANS coding is built along with it if `tans` is set
+  class block_encoder {
+  public:
+    // encode the blocks with encodings of at most `max_length` bits, split into `streams` streams, and with a tANS coding instead
+    // when it is smaller if `tans` is set
+    explicit block_encoder(int max_length, int streams = 1, bool tans = false) : max_length_(max_length), streams_(streams), tans_(tans) {}
+
+    // encode `size` symbols from `data` as the next block, and append it to `out`
+    void encode(huffman_encoding::alphabet_type const* data, size_t size, bitwriter& out) {
+      huffman_encoding encoding;
+      encoding.scan_input(data, size);
+      block_type type = screen_block_type(encoding, previous_.get(), streams_);
+      tans_encoding tans;
+      if (type == block_type::huffman) {
+        encoding.build_from_weights(max_length_);
+        encoding.use_compact_header();
+        if (tans_) {
+          tans.build_from_weights(encoding.weights_, encoding.original_size_);
+        }
+        type = choose_block_type(encoding, previous_.get(), streams_, tans_ ? &tans : nullptr);
+      }
+      if (carries_coding(type)) {
+        previous_ = std::make_shared<huffman_encoding const>(std::move(encoding));
+      }
+      encode_block(data, size, type, previous_.get(), out, streams_, &tans);
+    }
+
+  private:
+    int max_length_;
+    int streams_;
+    bool tans_;
+    std::shared_ptr<huffman_encoding const> previous_;  // coding of the last block that carried one
+  };
+
+  // encode `size` symbols from `data` as a block, with the dictionary `encoding` whose identifier is `id`, and append it to `out`
+  inline void encode_dictionary_block(huffman_encoding::alphabet_type const* data, size_t size, huffman_encoding const& encoding, uint64_t id, bitwriter& out) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; ++i) {
+      bits += encoding.lengths_[data[i]];
+    }
+    uint64_t payload_bytes = 8 + (bits + 7) / 8;
+    out.reserve(out.size() + (block_header_size + payload_bytes) * 8);
+    write_block_header(out, {block_type::huffman_dictionary, payload_bytes, size});
+    out.write(64, id);
+    encoding.encode(data, size, out);
+    align(out);
+  }
+
+  // append the end of stream marker to `out`
+  inline void write_end_of_stream(bitwriter& out) { write_block_header(out, {}); }
+
+  // an upper bound for the size of the payload of a block of `symbols` symbols, including the padding and the stream sizes of
+  // an interleaved block; a block larger than max_block_size is never valid, and its bound is zero, to avoid overflowing
+  inline uint64_t max_block_payload_size(uint64_t symbols) {
+    if (symbols > max_block_size) {
+      return 0;
+    }
+    return (huffman_encoding::full_header_size + symbols * huffman_encoding::max_code_length + 7) / 8 + 1 + 9 * max_streams;
+  }
+
+  // entry of the index of a container, for a block
+  struct index_entry {
+    uint64_t position = 0;       // position of the first symbol of the block in the decoded stream
+    uint64_t offset = 0;         // offset of the block header in the container, in bytes
+    uint64_t coding = no_coding; // offset of the header of the last block that carried a coding up to this one, in bytes
+  };
+
+  // builder of the index of a container, fed with the headers of the blocks in order
+  class index_builder {
+  public:
+    // add the block described by `header`, starting at `offset` bytes from the beginning of the container
+    void add(block_header const& header, uint64_t offset) {
+      if (carries_coding(header.type)) {
+        coding_ = offset;
+      }
+      entries_.push_back({position_, offset, coding_});
+      position_ += header.symbols;
+    }
+
+    // append the index and its trailer to `out`, after the end of stream marker
+    void write(bitwriter& out) const {
+      assert(out.size() % 8 == 0);
+      out.reserve(out.size() + (entries_.size() * index_entry_size + index_trailer_size) * 8);
+      for (index_entry const& entry : entries_) {
+        out.write(64, entry.position);
+        out.write(64, entry.offset);
+        out.write(64, entry.coding);
+      }
+      out.write(64, entries_.size());
+      for (uint8_t byte : index_magic) {
+        out.write(8, byte);
+      }
+    }
+
+    std::vector<index_entry> const& entries() const { return entries_; }
+
+  private:
+    std::vector<index_entry> entries_;
+    uint64_t position_ = 0;
+    uint64_t coding_ = no_coding;
+  };
+
+  // read the index at the end of the `size` bytes of a container in memory into `entries`; return false if the container does not
+  // end with an index, or if the index is corrupted; only the entries and the header of the last block are checked, so that the
+  // index can be read without walking through the blocks, and decode_range() checks the headers of the blocks it decodes
+  inline bool read_index(uint8_t const* data, size_t size, std::vector<index_entry>& entries) {
+    if (size < header_size + index_trailer_size or not is_container(data, size) or
+        std::memcmp(data + size - sizeof(index_magic), index_magic, sizeof(index_magic)) != 0) {
+      return false;
+    }
+    uint64_t block_size;
+    if (not read_header(data, block_size)) {
+      return false;
+    }
+    uint64_t count;
+    std::memcpy(&count, data + size - index_trailer_size, sizeof(count));
+    if (count > (size - header_size - index_trailer_size) / index_entry_size) {
+      return false;
+    }
+    uint8_t const* next = data + size - index_trailer_size - count * index_entry_size;
+    entries.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      index_entry& entry = entries[i];
+      std::memcpy(&entry.position, next, 8);
+      std::memcpy(&entry.offset, next + 8, 8);
+      std::memcpy(&entry.coding, next + 16, 8);
+      next += index_entry_size;
+      // the first block starts after the container header, and each block after the previous one, with up to `block_size` symbols
+      bool first = (i == 0);
+      if ((first and (entry.position != 0 or entry.offset != header_size)) or
+          (not first and (entry.position <= entries[i - 1].position or entry.position - entries[i - 1].position > block_size or
+                          entry.offset <= entries[i - 1].offset)) or
+          entry.offset > size - block_header_size or (entry.coding != no_coding and (entry.coding < header_size or entry.coding > entry.offset))) {
+        return false;
+      }
+    }
+    if (count == 0) {
+      return true;
+    }
+    // the last block ends with the end of stream marker
+    uint64_t offset = entries.back().offset;
+    block_header header = read_block_header(data + offset);
+    if (header.type == block_type::end_of_stream or header.symbols == 0 or header.symbols > block_size or
+        header.payload_size > size - offset - block_header_size) {
+      return false;
+    }
+    offset += block_header_size + header.payload_size;
+    return offset <= size - block_header_size and read_block_header(data + offset).type == block_type::end_of_stream;
+  }
+
+  // build the index of the `size` bytes of a container in memory into `entries`, by walking through the headers of its blocks, for
+  // a container that does not end with an index; return false if the container is truncated or corrupted
+  inline bool build_index(uint8_t const* data, size_t size, std::vector<index_entry>& entries) {
+    uint64_t block_size;
+    if (not is_container(data, size) or size < header_size or not read_header(data, block_size)) {
+      return false;
+    }
+    index_builder index;
+    for (size_t offset = header_size; offset + block_header_size <= size;) {
+      block_header header = read_block_header(data + offset);
+      if (header.type == block_type::end_of_stream) {
+        entries = index.entries();
+        return true;
+      }
+      if (header.symbols > block_size or header.payload_size > size - offset - block_header_size) {
+        return false;
+      }
+      index.add(header, offset);
+      offset += block_header_size + header.payload_size;
+    }
+    return false;
+  }
+
+  // scan the `size` bytes of a container in memory, and count the total number of symbols it contains;
+  // return false if the container is truncated or corrupted
+  inline bool scan_blocks(uint8_t const* data, size_t size, uint64_t& symbols) {
+    uint64_t block_size;
+    if (not is_container(data, size) or size < header_size or not read_header(data, block_size)) {
+      return false;
+    }
+    symbols = 0;
+    for (size_t offset = header_size; offset + block_header_size <= size;) {
+      block_header header = read_block_header(data + offset);
+      offset += block_header_size;
+      if (header.type == block_type::end_of_stream) {
+        return true;
+      }
+      if (header.symbols > block_size or header.payload_size > size - offset) {
+        return false;
+      }
+      offset += header.payload_size;
+      symbols += header.symbols;
+    }
+    return false;
+  }
+
+  // decode the `streams` interleaved streams of a block of `symbols` symbols into `out`
+  template <int Streams>
+  inline bool decode_streams(bitreader* in, uint64_t symbols, huffman_encoding::alphabet_type* out, huffman_decoder const& decoder) {
+    uint64_t segment = segment_size(symbols, Streams);
+    huffman_encoding::alphabet_type* outputs[Streams];
+    size_t counts[Streams];
+    for (int k = 0; k < Streams; ++k) {
+      outputs[k] = out + std::min(k * segment, symbols);
+      counts[k] = std::min((k + 1) * segment, symbols) - std::min(k * segment, symbols);
+    }
+    return decoder.decode_interleaved<Streams>(in, outputs, counts);
+  }
+
+  // decode the `size` bytes of `data`, holding the number of streams, their sizes and the streams of `symbols` symbols, into `out`
+  inline bool decode_streams(uint8_t const* data, uint64_t size, uint64_t symbols, huffman_encoding::alphabet_type* out, huffman_decoder const& decoder) {
+    // read the number of streams and their sizes, and check that they fit in the payload
+    uint64_t offset = 0;
+    if (offset + 1 > size) {
+      return false;
+    }
+    int streams = data[offset++];
+    if (streams < 1 or streams > max_streams or offset + 8 * streams > size) {
+      return false;
+    }
+    uint64_t stream_bytes[max_streams];
+    std::memcpy(stream_bytes, data + offset, 8 * streams);
+    offset += 8 * streams;
+    bitreader streams_in[max_streams];
+    for (int k = 0; k < streams; ++k) {
+      if (stream_bytes[k] > size - offset) {
+        return false;
+      }
+      streams_in[k] = bitreader(data + offset, stream_bytes[k] * 8);
+      offset += stream_bytes[k];
+    }
+
+    switch (streams) {
+      case 2: return decode_streams<2>(streams_in, symbols, out, decoder);
+      case 4: return decode_streams<4>(streams_in, symbols, out, decoder);
+      case 8: return decode_streams<8>(streams_in, symbols, out, decoder);
+      default: {
+        // other numbers of streams are decoded one after the other
+        uint64_t segment = segment_size(symbols, streams);
+        for (int k = 0; k < streams; ++k) {
+          uint64_t begin = std::min(k * segment, symbols);
+          uint64_t count = std::min((k + 1) * segment, symbols) - begin;
+          if (decoder.decode(streams_in[k], out + begin, count) != count) {
+            return false;
+          }
+        }
+        return true;
+      }
+    }
+  }
+
+  // decode the payload of a repeat block described by `header` into `out`, using `decoder`, that holds the decoding tables of the
+  // last block that carried a coding
+  inline bool decode_repeat_block(block_header const& header, uint8_t const* payload, huffman_encoding::alphabet_type* out, huffman_decoder const& decoder) {
+    return header.type == block_type::huffman_repeat and decode_streams(payload, header.payload_size, header.symbols, out, decoder);
+  }
+
+  // decode the payload of a block described by `header` into `out`, using `decoder` for the decoding tables, or the tables from
+  // `dictionaries` for a dictionary block; `decoder` is rebuilt by the blocks that carry a coding, and must hold the tables of the
+  // last one of them for a repeat block; `out` must have space for `header.symbols` symbols; return false if the block is corrupted
+  // or references an unknown dictionary
+  inline bool decode_block(block_header const& header, uint8_t const* payload, huffman_encoding::alphabet_type* out, huffman_decoder& decoder,
+                           dictionary::cache const* dictionaries = nullptr) {
+    if (header.payload_size > max_block_payload_size(header.symbols)) {
+      return false;
+    }
+    if (header.type == block_type::huffman_dictionary) {
+      uint64_t id;
+      if (header.payload_size < sizeof(id) or not dictionaries) {
+        return false;
+      }
+      std::memcpy(&id, payload, sizeof(id));
+      dictionary::cache::entry const* entry = dictionaries->find(id);
+      if (not entry) {
+        return false;
+      }
+      bitreader in(payload + sizeof(id), (header.payload_size - sizeof(id)) * 8);
+      return entry->decoder.decode(in, out, header.symbols) == header.symbols;
+    }
+    if (header.type == block_type::huffman_repeat) {
+      return decoder.built() and decode_repeat_block(header, payload, out, decoder);
+    }
+    if (header.type == block_type::stored) {
+      if (header.payload_size != header.symbols) {
+        return false;
+      }
+      std::memcpy(out, payload, header.symbols);
+      return true;
+    }
+    if (header.type == block_type::single_symbol) {
+      if (header.payload_size != 1) {
+        return false;
+      }
+      std::memset(out, payload[0], header.symbols);
+      return true;
+    }
+    if (header.type == block_type::tans) {
+      bitreader in(payload, header.payload_size * 8);
+      tans_encoding encoding;
+      if (not encoding.deserialise(in) or encoding.original_size_ != header.symbols or encoding.header_size_ + encoding.encoded_size_ > in.size()) {
+        return false;
+      }
+      // the table is small enough to be rebuilt on the stack for each block
+      tans_decoder tans(encoding);
+      in.truncate(encoding.header_size_ + encoding.encoded_size_);
+      return tans.decode(in, out, header.symbols) == header.symbols and in.tellg() == in.size();
+    }
+    if (not carries_coding(header.type)) {
+      return false;
+    }
+    bitreader in(payload, header.payload_size * 8);
+    huffman_encoding encoding;
+    if (not encoding.deserialise(in) or encoding.original_size_ != header.symbols or encoding.header_size_ + encoding.encoded_size_ > in.size()) {
+      return false;
+    }
+    decoder.build(encoding);
+    if (header.type == block_type::huffman) {
+      in.truncate(encoding.header_size_ + encoding.encoded_size_);
+      return decoder.decode(in, out, header.symbols) == header.symbols;
+    }
+
+    uint64_t offset = (encoding.header_size_ + 7) / 8;
+    return offset <= header.payload_size and decode_streams(payload + offset, header.payload_size - offset, header.symbols, out, decoder);
+  }
+
+  // read the coding of the block that carries one at `offset` bytes from the beginning of the `size` bytes of a container in
+  // memory, and build its decoding tables in `decoder`; return false if the block is corrupted
+  inline bool build_decoder(uint8_t const* data, size_t size, uint64_t offset, huffman_decoder& decoder) {
+    if (offset > size - block_header_size) {
+      return false;
+    }
+    block_header header = read_block_header(data + offset);
+    if (not carries_coding(header.type) or header.payload_size > size - offset - block_header_size) {
+      return false;
+    }
+    bitreader in(data + offset + block_header_size, header.payload_size * 8);
+    huffman_encoding encoding;
+    if (not encoding.deserialise(in) or encoding.original_size_ != header.symbols or encoding.header_size_ > in.size()) {
+      return false;
+    }
+    decoder.build(encoding);
+    return true;
+  }
+
+  // decode the `length` symbols starting at position `position` of the stream encoded in the `size` bytes of a container in
+  // memory into `out`, decoding only the blocks that cover them, found with the index `entries` read by read_index(); `decoder`
+  // and `dictionaries` are used as by decode_block(); return false if the range is past the end of the stream, or if a block is
+  // corrupted or references an unknown dictionary
+  inline bool decode_range(uint8_t const* data, size_t size, std::vector<index_entry> const& entries, uint64_t position, uint64_t length,
+                           huffman_encoding::alphabet_type* out, huffman_decoder& decoder, dictionary::cache const* dictionaries = nullptr) {
+    if (length == 0) {
+      return true;
+    }
+    uint64_t block_size;
+    if (not is_container(data, size) or size < header_size or not read_header(data, block_size)) {
+      return false;
+    }
+    // find the last block that starts at or before the first symbol of the range
+    auto it = std::upper_bound(entries.begin(), entries.end(), position, [](uint64_t position, index_entry const& entry) { return position < entry.position; });
+    if (it == entries.begin()) {
+      return false;
+    }
+    --it;
+
+    // the first block may reuse the coding of a previous block
+    if (it->coding != no_coding and it->coding != it->offset and not build_decoder(data, size, it->coding, decoder)) {
+      return false;
+    }
+    // the headers of the blocks are checked here, as read_index() only checks the entries of the index; each block after the first
+    // one must start where the previous one ends
+    std::vector<huffman_encoding::alphabet_type> buffer;
+    for (auto first = it; length > 0; ++it) {
+      if (it == entries.end() or it->offset > size - block_header_size or (it != first and it->position != position)) {
+        return false;
+      }
+      block_header header = read_block_header(data + it->offset);
+      if (header.type == block_type::end_of_stream or header.symbols > block_size or header.payload_size > size - it->offset - block_header_size or
+          it->position > position or it->position + header.symbols <= position) {
+        return false;
+      }
+      uint8_t const* payload = data + it->offset + block_header_size;
+      uint64_t skip = position - it->position;
+      uint64_t count = std::min(length, header.symbols - skip);
+      if (skip == 0 and count == header.symbols) {
+        // a block that is entirely in the range is decoded in place
+        if (not decode_block(header, payload, out, decoder, dictionaries)) {
+          return false;
+        }
+      } else {
+        buffer.resize(header.symbols);
+        if (not decode_block(header, payload, buffer.data(), decoder, dictionaries)) {
+          return false;
+        }
+        std::copy(buffer.begin() + skip, buffer.begin() + skip + count, out);
+      }
+      out += count;
+      position += count;
+      length -= count;
+    }
+    return true;
+  }
+
+}  // namespace container
+
+#endif  // container_h
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitwriter.h"
+#include "container.h"
+#include "decoder.h"
+
+int main(int argc, const char* argv[]) {
+  // build a message with a different distribution of symbols in each part
+  std::mt19937 random(42);
+  std::vector<uint8_t> message;
+  for (int part = 0; part < 8; ++part) {
+    std::geometric_distribution<int> distribution(0.1 * (part + 1));
+    for (int i = 0; i < 10000; ++i) {
+      message.push_back(static_cast<uint8_t>(std::min(distribution(random) + part * 16, 255)));
+    }
+  }
+
+  for (int streams : {1, 2, 3, 4, 8}) {
+    for (uint64_t block_size : {1ul, 1000ul, 4096ul, 100000ul}) {
+      // encode the message as a sequence of blocks
+      bitwriter writer;
+      container::write_header(writer, block_size);
+      for (size_t offset = 0; offset < message.size(); offset += block_size) {
+        container::encode_block(message.data() + offset, std::min(block_size, message.size() - offset), 15, writer, streams);
+      }
+      container::write_end_of_stream(writer);
+      writer.flush();
+      std::cout << "message of " << message.size() << " bytes encoded in blocks of " << block_size << " bytes with " << streams
+                << " streams: " << writer.bytes() << " bytes" << std::endl;
+
+      // scan the container
+      uint8_t const* data = writer.data();
+      bool valid = container::is_container(data, writer.bytes());
+      assert(valid);
+      uint64_t read_block_size;
+      valid = container::read_header(data, read_block_size);
+      assert(valid and read_block_size == block_size);
+      uint64_t symbols;
+      valid = container::scan_blocks(data, writer.bytes(), symbols);
+      assert(valid and symbols == message.size());
+
+      // a truncated container is detected
+      valid = container::scan_blocks(data, writer.bytes() - 1, symbols);
+      assert(not valid);
+
+      // so is a block size too large to be encoded
+      std::vector<uint8_t> oversized(data, data + writer.bytes());
+      oversized[container::header_size - 1] = 0xff;
+      valid = container::read_header(oversized.data(), read_block_size);
+      assert(not valid);
+      valid = container::scan_blocks(oversized.data(), oversized.size(), symbols);
+      assert(not valid);
+
+      // decode the blocks one by one
+      std::vector<uint8_t> decoded(message.size());
+      huffman_decoder decoder(huffman_decoder::default_table_bits, huffman_decoder::table_type::multi_symbol);
+      size_t offset = container::header_size;
+      uint64_t decoded_symbols = 0;
+      while (true) {
+        container::block_header header = container::read_block_header(data + offset);
+        offset += container::block_header_size;
+        if (header.type == container::block_type::end_of_stream) {
+          break;
+        }
+        assert(header.symbols <= block_size);
+        valid = container::decode_block(header, data + offset, decoded.data() + decoded_symbols, decoder);
+        assert(valid);
+        offset += header.payload_size;
+        decoded_symbols += header.symbols;
+      }
+      assert(offset == writer.bytes());
+      assert(decoded_symbols == message.size());
+      assert(decoded == message);
+    }
+  }
+
+  // with the adaptive encoder, the blocks of each part reuse the coding of the first one, random bytes are stored as they are,
+  // and a run of the same byte is stored as a single symbol
+  std::vector<uint8_t> adaptive = message;
+  for (int i = 0; i < 10000; ++i) {
+    adaptive.push_back(static_cast<uint8_t>(random()));
+  }
+  adaptive.insert(adaptive.end(), 5000, 'x');
+  for (int streams : {1, 3, 4}) {
+    uint64_t block_size = 2500;
+    bitwriter writer;
+    container::write_header(writer, block_size);
+    container::block_encoder encoder(15, streams);
+    for (size_t offset = 0; offset < adaptive.size(); offset += block_size) {
+      encoder.encode(adaptive.data() + offset, std::min(block_size, adaptive.size() - offset), writer);
+    }
+    container::write_end_of_stream(writer);
+    writer.flush();
+    std::cout << "message of " << adaptive.size() << " bytes encoded adaptively in blocks of " << block_size << " bytes with " << streams
+              << " streams: " << writer.bytes() << " bytes" << std::endl;
+
+    uint8_t const* data = writer.data();
+    std::vector<uint8_t> decoded(adaptive.size());
+    huffman_decoder decoder;
+    int counts[7] = {};
+    size_t offset = container::header_size;
+    uint64_t decoded_symbols = 0;
+    while (true) {
+      container::block_header header = container::read_block_header(data + offset);
+      offset += container::block_header_size;
+      if (header.type == container::block_type::end_of_stream) {
+        break;
+      }
+      ++counts[static_cast<int>(header.type)];
+      if (header.type == container::block_type::huffman_repeat) {
+        // a repeat block cannot be decoded without the tables of a previous block
+        huffman_decoder empty;
+        bool valid = container::decode_block(header, data + offset, decoded.data() + decoded_symbols, empty);
+        assert(not valid);
+      }
+      bool valid = container::decode_block(header, data + offset, decoded.data() + decoded_symbols, decoder);
+      assert(valid);
+      offset += header.payload_size;
+      decoded_symbols += header.symbols;
+    }
+    assert(decoded == adaptive);
+    assert(counts[static_cast<int>(container::block_type::huffman_repeat)] > 0);
+    assert(counts[static_cast<int>(container::block_type::stored)] == 4);
+    assert(counts[static_cast<int>(container::block_type::single_symbol)] == 2);
+
+    // the container without an index can be indexed by walking through its blocks; with the index appended, it can be read back
+    // from the end of the container
+    std::vector<container::index_entry> walked;
+    bool valid = container::build_index(data, writer.bytes(), walked);
+    assert(valid);
+    valid = container::read_index(data, writer.bytes(), walked);
+    assert(not valid);
+    container::index_builder index;
+    for (auto const& entry : walked) {
+      index.add(container::read_block_header(data + entry.offset), entry.offset);
+    }
+    index.write(writer);
+    writer.flush();
+    data = writer.data();
+    std::vector<container::index_entry> entries;
+    valid = container::read_index(data, writer.bytes(), entries);
+    assert(valid and entries.size() == walked.size());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      assert(entries[i].position == walked[i].position and entries[i].offset == walked[i].offset and entries[i].coding == walked[i].coding);
+    }
+    valid = container::scan_blocks(data, writer.bytes(), decoded_symbols);
+    assert(valid and decoded_symbols == adaptive.size());
+
+    // an index whose positions do not match the blocks, or a block larger than the block size, is corrupted
+    {
+      std::vector<uint8_t> corrupted(data, data + writer.bytes());
+      size_t last = corrupted.size() - container::index_trailer_size - container::index_entry_size;
+      corrupted[last + 7] ^= 0x40;
+      std::vector<container::index_entry> bad;
+      valid = container::read_index(corrupted.data(), corrupted.size(), bad);
+      assert(not valid);
+      corrupted[last + 7] ^= 0x40;
+      corrupted[entries.back().offset + 15] = 0x40;
+      valid = container::read_index(corrupted.data(), corrupted.size(), bad);
+      assert(not valid);
+      valid = container::build_index(corrupted.data(), corrupted.size(), bad);
+      assert(not valid);
+      std::vector<uint8_t> range(1);
+      huffman_decoder range_decoder;
+      valid = container::decode_range(corrupted.data(), corrupted.size(), entries, entries.back().position, 1, range.data(), range_decoder);
+      assert(not valid);
+    }
+
+    // the headers of the other blocks are not read with the index, but are checked when the blocks are decoded
+    {
+      std::vector<uint8_t> corrupted(data, data + writer.bytes());
+      corrupted[entries.front().offset + 15] = 0x40;
+      std::vector<container::index_entry> unchecked;
+      valid = container::read_index(corrupted.data(), corrupted.size(), unchecked);
+      assert(valid and unchecked.size() == entries.size());
+      std::vector<uint8_t> range(1);
+      huffman_decoder range_decoder;
+      valid = container::decode_range(corrupted.data(), corrupted.size(), unchecked, 0, 1, range.data(), range_decoder);
+      assert(not valid);
+    }
+
+    // decode ranges within a block, across blocks, and up to the end of the stream, with a fresh decoder each time
+    std::uniform_int_distribution<uint64_t> positions(0, adaptive.size());
+    for (int i = 0; i < 200; ++i) {
+      uint64_t position = positions(random);
+      uint64_t length = std::min<uint64_t>(adaptive.size() - position, i % 2 ? positions(random) % 100 : positions(random));
+      std::vector<uint8_t> range(length);
+      huffman_decoder range_decoder;
+      valid = container::decode_range(data, writer.bytes(), entries, position, length, range.data(), range_decoder);
+      assert(valid and std::equal(range.begin(), range.end(), adaptive.begin() + position));
+    }
+    std::vector<uint8_t> range(2);
+    valid = container::decode_range(data, writer.bytes(), entries, adaptive.size() - 1, 2, range.data(), decoder);
+    assert(not valid);
+  }
+}
@@ -0,0 +1,81 @@
+#ifndef cpu_h
+#define cpu_h
+
+#include <cstdlib>
+#include <cstring>
+
+/* run-time selection of the instruction set used by the hot kernels
+ *
+ * The binaries are built for the baseline of the architecture, and the kernels that benefit from a newer instruction set have a
+ * variant compiled for it with a target attribute: the bulk encoding of the bitwriter, and the table decoding.
+ * Each variant is the same source, inlined into a function compiled for the target, so that the compiler can use e.g. the BMI2
+ * shifts and bit extractions, and the wider vectors. The variant is selected once, from the features reported by the processor:
+ *
+ *   scalar   the baseline of the architecture
+ *   avx2     AVX2, BMI1, BMI2 and POPCNT (Haswell, Zen and later)
+ *   avx512   the above, and AVX-512 F, BW and VL (Skylake-X, Zen 4 and later)
+ *
+ * A kernel without a variant for the selected level uses the variant of the highest level below it; none has an avx512 variant
+ * yet, so that level runs the avx2 ones. The environment variable WITHER_CPU can force a lower level (scalar, avx2 or avx512),
+ * e.g. for benchmarking; a level that the processor does not support, or an unknown name, is ignored.
+ */
+
+#if defined(__x86_64__) or defined(__i386__)
+#define WITHER_DISPATCH 1
+#define WITHER_TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,popcnt")))
+#else
+#define WITHER_DISPATCH 0
+#endif
+
+namespace cpu {
+
+  enum class level { scalar = 0, avx2 = 1, avx512 = 2 };
+
+  // name of the instruction set `value`
+  inline const char* name(level value) {
+    switch (value) {
+      case level::avx2: return "avx2";
+      case level::avx512: return "avx512";
+      default: return "scalar";
+    }
+  }
+
+  // highest level supported by the processor
+  inline level detected() {
+#if WITHER_DISPATCH
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") and __builtin_cpu_supports("bmi") and __builtin_cpu_supports("bmi2") and
+                __builtin_cpu_supports("popcnt");
+    if (avx2 and __builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw") and __builtin_cpu_supports("avx512vl")) {
+      return level::avx512;
+    }
+    if (avx2) {
+      return level::avx2;
+    }
+#endif
+    return level::scalar;
+  }
+
+  // level selected for the kernels: the detected one, unless WITHER_CPU asks for a lower one
+  inline level select() {
+    level supported = detected();
+    const char* requested = std::getenv("WITHER_CPU");
+    if (requested) {
+      for (level value : {level::scalar, level::avx2, level::avx512}) {
+        if (std::strcmp(requested, name(value)) == 0 and value <= supported) {
+          return value;
+        }
+      }
+    }
+    return supported;
+  }
+
+  // level selected for the kernels, computed on the first call
+  inline level selected() {
+    static const level value = select();
+    return value;
+  }
+
+}  // namespace cpu
+
+#endif  // cpu_h
@@ -0,0 +1,86 @@
+// decode a block container, or a single-table stream with checkpoints, on a CUDA device and output the result
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "container.h"
+#include "cuda_decoder.h"
+#include "dictionary.h"
+#include "file_io.h"
+#include "huffman.h"
+
+
+int main(int argc, const char* argv[]) {
+  // no need to synchronise the C++ I/O streams with the C I/O streams
+  std::ios::sync_with_stdio(false);
+
+  // parse the command line options, and collect the input and output file names
+  //   --dictionary FILE  load the pre-trained table from FILE, for the blocks that reference it; can be repeated
+  std::vector<const char*> dictionary_names;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--dictionary") == 0 and i + 1 < argc) {
+      dictionary_names.push_back(argv[++i]);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  const char* input_name = args.size() < 1 ? "-" : args[0];
+  const char* output_name = args.size() < 2 ? "-" : args[1];
+
+  dictionary::cache dictionaries;
+  for (const char* name : dictionary_names) {
+    huffman_encoding encoding;
+    if (not dictionary::load(name, encoding)) {
+      std::cerr << "cannot read the dictionary " << name << std::endl;
+      return 1;
+    }
+    dictionaries.add(encoding);
+  }
+
+  // the headers and the codings are read on the host, to plan the decoding
+  input_file input;
+  if (not input.open(input_name)) {
+    std::cerr << "cannot open the input file " << input_name << std::endl;
+    return 1;
+  }
+  uint8_t const* input_data;
+  size_t input_size = input.read_all(input_data);
+  if (input.error()) {
+    std::cerr << "error reading the input file" << std::endl;
+    return 1;
+  }
+  cuda::plan work;
+  bool planned = container::is_container(input_data, input_size) ? cuda::plan_container(input_data, input_size, work, &dictionaries)
+                                                                 : cuda::plan_single_table(input_data, input_size, work);
+  if (not planned) {
+    std::cerr << "the input is corrupted, or cannot be decoded on the device: use decode instead" << std::endl;
+    return 1;
+  }
+
+  // copy the input to the device, decode it there, and copy the output back
+  uint8_t* device_input = nullptr;
+  uint8_t* device_output = nullptr;
+  std::vector<uint8_t> output_buffer(work.symbols);
+  bool decoded = cudaMalloc(&device_input, input_size + 1) == cudaSuccess and cudaMalloc(&device_output, work.symbols + 1) == cudaSuccess and
+                 cudaMemcpy(device_input, input_data, input_size, cudaMemcpyHostToDevice) == cudaSuccess and
+                 cuda::decode(work, device_input, input_size, device_output) and
+                 cudaMemcpy(output_buffer.data(), device_output, work.symbols, cudaMemcpyDeviceToHost) == cudaSuccess;
+  cudaFree(device_input);
+  cudaFree(device_output);
+  if (not decoded) {
+    std::cerr << "the input is corrupted, or the device failed: " << cudaGetErrorString(cudaGetLastError()) << std::endl;
+    return 1;
+  }
+
+  output_file output;
+  if (not output.open(output_name) or not output.write(output_buffer.data(), output_buffer.size())) {
+    std::cerr << "cannot write the output file " << output_name << std::endl;
+    return 1;
+  }
+  return output.flush() ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// decode the tasks of a plan on a CUDA device (see cuda_decoder.h)
+
+#include <cstdint>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "cuda_decoder.h"
+
+namespace cuda {
+
+  namespace {
+
+    constexpr int threads_per_block = group_size;
+
+    // bit buffer over the `end` bits of `data`, read one byte at a time, as the streams are not aligned
+    struct bit_buffer {
+      uint8_t const* data;
+      uint64_t position;  // position of the next bit to be consumed
+      uint64_t end;
+      uint64_t next;      // position of the next byte to be loaded, in bytes
+      uint64_t buffer;
+      int available;      // number of bits in `buffer`, including the ones past `end`
+
+      __device__ bit_buffer(uint8_t const* data, uint64_t begin, uint64_t end)
+          : data(data), position(begin), end(end), next(begin / 8), buffer(0), available(0) {
+        refill();
+        buffer >>= begin % 8;
+        available -= begin % 8;
+      }
+
+      // load whole bytes until the buffer holds at least 56 bits, or the end of the stream; the bits past the end are 0
+      __device__ void refill() {
+        uint64_t last = (end + 7) / 8;
+        while (available <= 56) {
+          uint64_t byte = next < last ? __ldg(data + next) : 0;
+          buffer |= byte << available;
+          available += 8;
+          ++next;
+        }
+      }
+    };
+
+    // decode the `count` tasks from `first`, with `table` built from the lengths of their coding, one task per thread; the
+    // canonical search for the encodings longer than `table_bits` uses the first code, first index and count of each length
+    __device__ bool decode_task(task const& item, uint8_t const* data, uint8_t* out, uint16_t const* table, uint64_t const* first_code,
+                                uint32_t const* first_index, uint32_t const* counts, uint8_t const* symbols, int max_length) {
+      uint64_t end = item.offset + item.bits;
+      bit_buffer in(data, item.offset, end);
+      uint8_t* output = out + item.output;
+      for (uint64_t i = 0; i < item.symbols; ++i) {
+        if (in.available <= 56) {
+          in.refill();
+        }
+        uint16_t entry = table[in.buffer & ((1u << table_bits) - 1)];
+        int length = entry >> 8;
+        uint8_t symbol = entry & 0xff;
+        if (length == 0) {
+          // slow path: the first bit of the stream is the MSB of the canonical code
+          uint64_t inverted = __brevll(in.buffer);
+          for (length = table_bits + 1; length <= max_length; ++length) {
+            uint64_t code = inverted >> (64 - length);
+            if (code - first_code[length] < counts[length]) {
+              symbol = symbols[first_index[length] + (code - first_code[length])];
+              break;
+            }
+          }
+          if (length > max_length) {
+            return false;
+          }
+        }
+        if (in.position + length > end) {
+          // truncated encoding
+          return false;
+        }
+        output[i] = symbol;
+        in.buffer >>= length;
+        in.available -= length;
+        in.position += length;
+      }
+      return not item.exact or in.position == end;
+    }
+
+    __global__ void decode_kernel(uint8_t const* data, uint64_t size, uint8_t* out, uint64_t symbols, task const* tasks,
+                                  group const* groups, uint8_t const* lengths, unsigned int* failures) {
+      __shared__ uint16_t table[1 << table_bits];  // symbol and length of each index, or 0 for the longer encodings
+      __shared__ uint64_t first_code[max_code_length + 1];
+      __shared__ uint32_t first_index[max_code_length + 1];
+      __shared__ uint32_t counts[max_code_length + 1];
+      __shared__ uint64_t codes[alphabet_size];     // encoding of each symbol, with the first bit in the LSB
+      __shared__ uint8_t sorted[alphabet_size];     // symbols sorted by encoding length, and then by symbol
+      __shared__ int max_length;
+
+      group const work = groups[blockIdx.x];
+      for (uint32_t i = 0; i < work.count; ++i) {
+        task const& item = tasks[work.first + i];
+        if (item.offset + item.bits > size * 8 or item.output + item.symbols > symbols) {
+          if (threadIdx.x == 0) {
+            atomicAdd(failures, 1);
+          }
+          return;
+        }
+      }
+
+      // the stored and fill tasks are copied by all the threads together
+      if (work.type != task_type::huffman) {
+        for (uint32_t i = 0; i < work.count; ++i) {
+          task const& item = tasks[work.first + i];
+          for (uint64_t k = threadIdx.x; k < item.symbols; k += blockDim.x) {
+            out[item.output + k] = work.type == task_type::fill ? item.symbol : data[item.offset / 8 + k];
+          }
+        }
+        return;
+      }
+
+      // 1. build the canonical coding from the lengths, as done by build_canonical_coding(), on one thread
+      uint8_t const* coding = lengths + uint64_t(work.coding) * alphabet_size;
+      if (threadIdx.x == 0) {
+        for (int length = 0; length <= max_code_length; ++length) {
+          counts[length] = 0;
+        }
+        max_length = 0;
+        for (int i = 0; i < alphabet_size; ++i) {
+          ++counts[coding[i]];
+          max_length = max(max_length, int(coding[i]));
+        }
+        uint64_t code = 0;
+        uint32_t index = 0;
+        counts[0] = 0;
+        for (int length = 1; length <= max_length; ++length) {
+          code = (code + counts[length - 1]) << 1;
+          first_code[length] = code;
+          first_index[length] = index;
+          index += counts[length];
+        }
+        uint32_t next[max_code_length + 1];
+        for (int length = 0; length <= max_length; ++length) {
+          next[length] = first_index[length];
+        }
+        for (int i = 0; i < alphabet_size; ++i) {
+          int length = coding[i];
+          if (length > 0) {
+            uint32_t rank = next[length]++;
+            sorted[rank] = i;
+            codes[i] = __brevll(first_code[length] + (rank - first_index[length])) >> (64 - length);
+          }
+        }
+      }
+      for (int index = threadIdx.x; index < (1 << table_bits); index += blockDim.x) {
+        table[index] = 0;
+      }
+      __syncthreads();
+
+      // 2. fill the table: a symbol of length L fills all the entries whose lowest L bits match its encoding
+      for (int i = threadIdx.x; i < alphabet_size; i += blockDim.x) {
+        int length = coding[i];
+        if (length > 0 and length <= table_bits) {
+          for (uint32_t index = codes[i]; index < (1u << table_bits); index += 1u << length) {
+            table[index] = uint16_t(length << 8 | i);
+          }
+        }
+      }
+      __syncthreads();
+
+      // 3. decode one task per thread
+      for (uint32_t i = threadIdx.x; i < work.count; i += blockDim.x) {
+        if (not decode_task(tasks[work.first + i], data, out, table, first_code, first_index, counts, sorted, max_length)) {
+          atomicAdd(failures, 1);
+        }
+      }
+    }
+
+    // device copy of the vector `values`, or nullptr for an empty one
+    template <typename T>
+    bool upload(std::vector<T> const& values, T*& device, cudaStream_t stream) {
+      device = nullptr;
+      if (values.empty()) {
+        return true;
+      }
+      return cudaMallocAsync(&device, values.size() * sizeof(T), stream) == cudaSuccess and
+             cudaMemcpyAsync(device, values.data(), values.size() * sizeof(T), cudaMemcpyHostToDevice, stream) == cudaSuccess;
+    }
+
+  }  // namespace
+
+  bool decode(plan const& work, uint8_t const* device_data, size_t size, uint8_t* device_out, cudaStream_t stream) {
+    if (work.groups.empty()) {
+      return true;
+    }
+    task* tasks = nullptr;
+    group* groups = nullptr;
+    uint8_t* lengths = nullptr;
+    unsigned int* failures = nullptr;
+    unsigned int failed = 0;
+    bool ok = upload(work.tasks, tasks, stream) and upload(work.groups, groups, stream) and upload(work.lengths, lengths, stream) and
+              cudaMallocAsync(&failures, sizeof(failed), stream) == cudaSuccess and
+              cudaMemsetAsync(failures, 0, sizeof(failed), stream) == cudaSuccess;
+    if (ok) {
+      decode_kernel<<<work.groups.size(), threads_per_block, 0, stream>>>(device_data, size, device_out, work.symbols, tasks, groups, lengths, failures);
+      ok = cudaGetLastError() == cudaSuccess and
+           cudaMemcpyAsync(&failed, failures, sizeof(failed), cudaMemcpyDeviceToHost, stream) == cudaSuccess and
+           cudaStreamSynchronize(stream) == cudaSuccess;
+    }
+    for (void* pointer : {static_cast<void*>(tasks), static_cast<void*>(groups), static_cast<void*>(lengths), static_cast<void*>(failures)}) {
+      if (pointer) {
+        cudaFreeAsync(pointer, stream);
+      }
+    }
+    return ok and failed == 0;
+  }
+
+}  // namespace cuda
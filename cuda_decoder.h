@@ -0,0 +1,308 @@
+#ifndef cuda_decoder_h
+#define cuda_decoder_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "bitreader.h"
+#include "checkpoints.h"
+#include "container.h"
+#include "decoder.h"
+#include "dictionary.h"
+#include "huffman.h"
+
+/* batched decoding of many independent streams on a CUDA device
+ *
+ * The parallelism comes from the format: the blocks of a container are independent once their coding is known, the streams of
+ * an interleaved or repeat block are independent, and so are the parts between the checkpoints of a single-table stream. A plan
+ * lists these streams as tasks, each with the bit range of its encodings in the input, the place and number of its symbols in the
+ * output, and the code lengths of its coding; the tasks that share a coding are grouped, so that the decoding table is built once
+ * per group, in shared memory, from the code lengths.
+ *
+ * The plan is made on the host, from the headers and the serialised codings: plan_container() and plan_single_table() read the
+ * encoded input in host memory (e.g. a mapped file), whose payloads are then decoded from a copy in device memory, at the same
+ * offsets. The blocks that the device does not decode, the tANS blocks and the codings longer than `max_code_length`, make the
+ * plan fail, and are left to the CPU decoder.
+ *
+ * decode_reference() decodes a plan on the host with huffman_decoder, the same way as the device does, so that the plans can be
+ * checked without a device; decode() is only available when linked with cuda_decoder.cu, built by `make cuda`.
+ */
+
+// the type of the CUDA streams, as declared by the CUDA runtime
+typedef struct CUstream_st* cudaStream_t;
+
+namespace cuda {
+
+  constexpr int alphabet_size = huffman_encoding::alphabet_size;
+  constexpr int max_code_length = 56;  // longest encoding decoded by the device, that fits in its 64-bit bit buffer
+  constexpr int table_bits = 10;       // bits indexing the decoding table in shared memory
+  constexpr int group_size = 64;       // maximum number of tasks sharing a table, decoded by the threads of a thread block
+
+  enum class task_type : uint8_t {
+    huffman = 0,  // decode `symbols` symbols from `bits` bits
+    stored = 1,   // copy `symbols` bytes
+    fill = 2      // repeat `symbol` `symbols` times
+  };
+
+  struct task {
+    uint64_t offset = 0;   // position of the first encoded bit in the input, in bits
+    uint64_t bits = 0;     // number of encoded bits
+    uint64_t output = 0;   // position of the first symbol in the output
+    uint64_t symbols = 0;  // number of symbols
+    task_type type = task_type::huffman;
+    bool exact = false;    // the encodings must end exactly after `bits` bits, rather than within the last byte
+    uint8_t symbol = 0;    // symbol repeated by a fill task
+  };
+
+  struct group {
+    uint32_t coding = 0;  // index of the code lengths of the tasks
+    uint32_t first = 0;   // index of the first task
+    uint32_t count = 0;   // number of tasks
+    task_type type = task_type::huffman;
+  };
+
+  struct plan {
+    std::vector<uint8_t> lengths;  // `alphabet_size` code lengths for each coding
+    std::vector<task> tasks;
+    std::vector<group> groups;
+    uint64_t symbols = 0;          // size of the decoded output
+
+    int codings() const { return static_cast<int>(lengths.size() / alphabet_size); }
+
+    // add the coding `encoding`, and return its index
+    uint32_t add_coding(huffman_encoding const& encoding) {
+      lengths.insert(lengths.end(), std::begin(encoding.lengths_), std::end(encoding.lengths_));
+      return codings() - 1;
+    }
+
+    // add a task with the coding `coding`, extending the last group when it has the same coding and room for it
+    void add(task const& item, uint32_t coding = 0) {
+      if (groups.empty() or groups.back().coding != coding or groups.back().type != item.type or groups.back().count == group_size) {
+        groups.push_back({coding, static_cast<uint32_t>(tasks.size()), 0, item.type});
+      }
+      ++groups.back().count;
+      tasks.push_back(item);
+    }
+  };
+
+  namespace detail {
+
+    // true if the device can decode the coding `encoding`
+    inline bool supported(huffman_encoding const& encoding) {
+      return *std::max_element(encoding.lengths_, encoding.lengths_ + alphabet_size) <= max_code_length;
+    }
+
+    // add the tasks of the streams section of a block, at `offset` bytes in the input and of `size` bytes, holding the number of
+    // streams, their sizes and the streams of `symbols` symbols decoded at `output`, as read by container::decode_streams()
+    inline bool add_streams(uint8_t const* data, uint64_t offset, uint64_t size, uint64_t symbols, uint64_t output, uint32_t coding, plan& work) {
+      if (size < 1) {
+        return false;
+      }
+      int streams = data[offset];
+      if (streams < 1 or streams > container::max_streams or 1 + 8 * uint64_t(streams) > size) {
+        return false;
+      }
+      uint64_t stream_bytes[container::max_streams];
+      std::memcpy(stream_bytes, data + offset + 1, 8 * streams);
+      uint64_t position = 1 + 8 * streams;
+      uint64_t segment = container::segment_size(symbols, streams);
+      for (int k = 0; k < streams; ++k) {
+        if (stream_bytes[k] > size - position) {
+          return false;
+        }
+        uint64_t begin = std::min(k * segment, symbols);
+        task item;
+        item.offset = (offset + position) * 8;
+        item.bits = stream_bytes[k] * 8;
+        item.output = output + begin;
+        item.symbols = std::min((k + 1) * segment, symbols) - begin;
+        work.add(item, coding);
+        position += stream_bytes[k];
+      }
+      return true;
+    }
+
+  }  // namespace detail
+
+  // plan the decoding of the block container in the `size` bytes of `data`, with the pre-trained codings of `dictionaries` for
+  // the dictionary blocks; return false if the container is corrupted, or holds blocks that the device cannot decode
+  inline bool plan_container(uint8_t const* data, size_t size, plan& work, dictionary::cache const* dictionaries = nullptr) {
+    work = plan();
+    if (not container::is_container(data, size) or size < container::header_size) {
+      return false;
+    }
+    uint64_t offset = container::header_size;
+    int64_t last = -1;  // coding of the last block that carried one
+    std::vector<std::pair<uint64_t, uint32_t>> dictionary_codings;  // coding of each dictionary referenced so far
+    while (size - offset >= container::block_header_size) {
+      container::block_header header = container::read_block_header(data + offset);
+      offset += container::block_header_size;
+      if (header.type == container::block_type::end_of_stream) {
+        return true;
+      }
+      if (header.payload_size > size - offset or header.payload_size > container::max_block_payload_size(header.symbols)) {
+        return false;
+      }
+      uint8_t const* payload = data + offset;
+      task item;
+      item.output = work.symbols;
+      item.symbols = header.symbols;
+      switch (header.type) {
+        case container::block_type::stored:
+          if (header.payload_size != header.symbols) {
+            return false;
+          }
+          item.type = task_type::stored;
+          item.offset = offset * 8;
+          item.bits = header.payload_size * 8;
+          work.add(item);
+          break;
+        case container::block_type::single_symbol:
+          if (header.payload_size != 1) {
+            return false;
+          }
+          item.type = task_type::fill;
+          item.symbol = payload[0];
+          work.add(item);
+          break;
+        case container::block_type::huffman_dictionary: {
+          uint64_t id;
+          if (header.payload_size < sizeof(id) or not dictionaries) {
+            return false;
+          }
+          std::memcpy(&id, payload, sizeof(id));
+          auto known = std::find_if(dictionary_codings.begin(), dictionary_codings.end(), [id](auto const& coding) { return coding.first == id; });
+          if (known == dictionary_codings.end()) {
+            dictionary::cache::entry const* entry = dictionaries->find(id);
+            if (not entry or not detail::supported(entry->encoding)) {
+              return false;
+            }
+            known = dictionary_codings.insert(known, {id, work.add_coding(entry->encoding)});
+          }
+          item.offset = (offset + sizeof(id)) * 8;
+          item.bits = (header.payload_size - sizeof(id)) * 8;
+          work.add(item, known->second);
+          break;
+        }
+        case container::block_type::huffman_repeat:
+          if (last < 0 or not detail::add_streams(data, offset, header.payload_size, header.symbols, work.symbols, last, work)) {
+            return false;
+          }
+          break;
+        case container::block_type::huffman:
+        case container::block_type::huffman_interleaved: {
+          bitreader in(payload, header.payload_size * 8);
+          huffman_encoding encoding;
+          if (not encoding.deserialise(in) or encoding.original_size_ != header.symbols or encoding.header_size_ + encoding.encoded_size_ > in.size() or
+              not detail::supported(encoding)) {
+            return false;
+          }
+          last = work.add_coding(encoding);
+          if (header.type == container::block_type::huffman) {
+            item.offset = offset * 8 + encoding.header_size_;
+            item.bits = encoding.encoded_size_;
+            item.exact = true;
+            work.add(item, last);
+          } else {
+            uint64_t coding_bytes = (encoding.header_size_ + 7) / 8;
+            if (coding_bytes > header.payload_size or
+                not detail::add_streams(data, offset + coding_bytes, header.payload_size - coding_bytes, header.symbols, work.symbols, last, work)) {
+              return false;
+            }
+          }
+          break;
+        }
+        default:
+          // tANS blocks, and unknown types
+          return false;
+      }
+      offset += header.payload_size;
+      work.symbols += header.symbols;
+    }
+    return false;
+  }
+
+  // plan the decoding of the single-table stream of 8-bit symbols in the `size` bytes of `data`, from each of its checkpoints if it
+  // has some; return false if the stream is corrupted, or if the device cannot decode its coding
+  inline bool plan_single_table(uint8_t const* data, size_t size, plan& work) {
+    work = plan();
+    bitreader in(data, size * 8);
+    bool checkpointed = checkpoints::has_checkpoints(data, size);
+    if (checkpointed) {
+      in.skip(64);
+    }
+    huffman_encoding encoding;
+    if (not encoding.deserialise(in)) {
+      return false;
+    }
+    uint64_t interval = encoding.original_size_;
+    std::vector<uint64_t> offsets;
+    if (checkpointed and not checkpoints::read(in, encoding, interval, offsets)) {
+      return false;
+    }
+    uint64_t begin = in.tellg();
+    if (in.size() - begin < encoding.encoded_size_ or not detail::supported(encoding)) {
+      return false;
+    }
+    uint32_t coding = work.add_coding(encoding);
+    work.symbols = encoding.original_size_;
+    for (uint64_t i = 0; i <= offsets.size(); ++i) {
+      // each part ends exactly at the next checkpoint
+      task item;
+      item.offset = begin + (i == 0 ? 0 : offsets[i - 1]);
+      item.bits = (i == offsets.size() ? encoding.encoded_size_ : offsets[i]) - (i == 0 ? 0 : offsets[i - 1]);
+      item.output = i * interval;
+      item.symbols = std::min<uint64_t>(interval, encoding.original_size_ - item.output);
+      item.exact = true;
+      work.add(item, coding);
+    }
+    return true;
+  }
+
+  // decode the tasks of `work` on the host, from the `size` bytes of `data` into `out`, that must have space for `work.symbols`
+  // symbols; return false if a task is corrupted
+  inline bool decode_reference(plan const& work, uint8_t const* data, size_t size, uint8_t* out) {
+    huffman_decoder decoder(table_bits, huffman_decoder::table_type::single_symbol);
+    int64_t built = -1;
+    for (group const& tasks : work.groups) {
+      if (tasks.type == task_type::huffman and int64_t(tasks.coding) != built) {
+        huffman_encoding encoding;
+        std::copy(work.lengths.begin() + tasks.coding * alphabet_size, work.lengths.begin() + (tasks.coding + 1) * alphabet_size, encoding.lengths_);
+        encoding.build_canonical_coding();
+        decoder.build(encoding);
+        built = tasks.coding;
+      }
+      for (uint32_t i = tasks.first; i < tasks.first + tasks.count; ++i) {
+        task const& item = work.tasks[i];
+        if (item.offset + item.bits > size * 8 or item.output + item.symbols > work.symbols) {
+          return false;
+        }
+        if (item.type == task_type::fill) {
+          std::memset(out + item.output, item.symbol, item.symbols);
+          continue;
+        }
+        if (item.type == task_type::stored) {
+          std::memcpy(out + item.output, data + item.offset / 8, item.symbols);
+          continue;
+        }
+        bitreader in(data, item.offset + item.bits);
+        in.seekg(item.offset);
+        if (decoder.decode(in, out + item.output, item.symbols) != item.symbols or (item.exact and in.tellg() != in.size())) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // decode the tasks of `work` on the device, from the `size` bytes of `device_data` into `device_out`, that must have space for
+  // `work.symbols` symbols, with the copies and the kernel queued on `stream`; return false if a task is corrupted, or after a
+  // CUDA error
+  bool decode(plan const& work, uint8_t const* device_data, size_t size, uint8_t* device_out, cudaStream_t stream = nullptr);
+
+}  // namespace cuda
+
+#endif  // cuda_decoder_h
@@ -0,0 +1,128 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitwriter.h"
+#include "checkpoints.h"
+#include "container.h"
+#include "cuda_decoder.h"
+#include "dictionary.h"
+#include "huffman.h"
+#include "thread_pool.h"
+
+// plan the decoding of the container or single-table stream in `writer`, check it against `message` with the reference decoder,
+// and return the plan
+cuda::plan check_plan(bitwriter const& writer, std::vector<uint8_t> const& message, dictionary::cache const* dictionaries = nullptr) {
+  cuda::plan work;
+  bool container = container::is_container(writer.data(), writer.bytes());
+  bool planned = container ? cuda::plan_container(writer.data(), writer.bytes(), work, dictionaries) : cuda::plan_single_table(writer.data(), writer.bytes(), work);
+  assert(planned and work.symbols == message.size());
+  for (auto const& group : work.groups) {
+    assert(group.count > 0 and group.count <= cuda::group_size and group.coding < uint32_t(std::max(work.codings(), 1)));
+  }
+  std::vector<uint8_t> decoded(message.size());
+  bool decoded_ok = cuda::decode_reference(work, writer.data(), writer.bytes(), decoded.data());
+  assert(decoded_ok and decoded == message);
+
+  // a plan is not made from a truncated input
+  cuda::plan truncated;
+  planned = container ? cuda::plan_container(writer.data(), writer.bytes() - 1, truncated, dictionaries)
+                      : message.size() > 0 and cuda::plan_single_table(writer.data(), writer.bytes() / 2, truncated);
+  assert(not planned);
+  return work;
+}
+
+int main(int argc, const char* argv[]) {
+  // a message with a different distribution of symbols in each part, random bytes, and a run of the same byte
+  std::mt19937 random(42);
+  std::vector<uint8_t> message;
+  for (int part = 0; part < 8; ++part) {
+    std::geometric_distribution<int> distribution(0.1 * (part + 1));
+    for (int i = 0; i < 10000; ++i) {
+      message.push_back(static_cast<uint8_t>(std::min(distribution(random) + part * 16, 255)));
+    }
+  }
+  for (int i = 0; i < 10000; ++i) {
+    message.push_back(static_cast<uint8_t>(random()));
+  }
+  message.insert(message.end(), 5000, 'x');
+
+  // containers with all the block types that the device decodes, each stream of a block being a separate task
+  for (int streams : {1, 3, 8}) {
+    uint64_t block_size = 2500;
+    bitwriter writer;
+    container::write_header(writer, block_size);
+    container::block_encoder encoder(15, streams);
+    for (size_t offset = 0; offset < message.size(); offset += block_size) {
+      encoder.encode(message.data() + offset, std::min(block_size, message.size() - offset), writer);
+    }
+    container::write_end_of_stream(writer);
+    writer.flush();
+    cuda::plan work = check_plan(writer, message);
+    std::cout << "container with " << streams << " streams: " << work.tasks.size() << " tasks in " << work.groups.size() << " groups, "
+              << work.codings() << " codings" << std::endl;
+    assert(work.tasks.size() >= (message.size() - 15000) / block_size * streams);
+  }
+
+  // the blocks encoded with a dictionary share its coding
+  {
+    dictionary::cache dictionaries;
+    dictionary::cache::entry const& entry = dictionaries.add(dictionary::train(message.data(), message.size(), 15));
+    bitwriter writer;
+    container::write_header(writer, 1000);
+    for (size_t offset = 0; offset < message.size(); offset += 1000) {
+      container::encode_dictionary_block(message.data() + offset, std::min<size_t>(1000, message.size() - offset), entry.encoding, entry.id, writer);
+    }
+    container::write_end_of_stream(writer);
+    writer.flush();
+    cuda::plan work = check_plan(writer, message, &dictionaries);
+    assert(work.codings() == 1 and work.groups.size() == (work.tasks.size() + cuda::group_size - 1) / cuda::group_size);
+
+    // and cannot be planned without it
+    cuda::plan missing;
+    bool planned = cuda::plan_container(writer.data(), writer.bytes(), missing);
+    assert(not planned);
+  }
+
+  // the tANS blocks are left to the CPU decoder
+  {
+    std::vector<uint8_t> skewed(20000);
+    for (auto& symbol : skewed) {
+      symbol = random() % 20 == 0 ? random() % 16 : 0;
+    }
+    bitwriter writer;
+    container::write_header(writer, skewed.size());
+    container::block_encoder encoder(15, 1, true);
+    encoder.encode(skewed.data(), skewed.size(), writer);
+    container::write_end_of_stream(writer);
+    writer.flush();
+    cuda::plan work;
+    bool planned = cuda::plan_container(writer.data(), writer.bytes(), work);
+    assert(not planned);
+  }
+
+  // single-table streams, decoded from each checkpoint
+  thread_pool pool(0);
+  for (size_t size : {size_t(0), size_t(1), size_t(4096), message.size()}) {
+    std::vector<uint8_t> part(message.begin(), message.begin() + size);
+    for (uint64_t interval : {uint64_t(0), uint64_t(1000), uint64_t(65536)}) {
+      huffman_encoding encoding(part.data(), part.size(), 15);
+      bitwriter writer;
+      std::vector<uint64_t> offsets;
+      if (interval > 0) {
+        offsets = checkpoints::offsets(encoding, part.data(), part.size(), interval, pool);
+        checkpoints::write_marker(writer);
+      }
+      encoding.serialise(writer);
+      if (interval > 0) {
+        checkpoints::write(writer, interval, offsets);
+      }
+      encoding.encode(part.data(), part.size(), writer);
+      writer.flush();
+      cuda::plan work = check_plan(writer, part);
+      assert(work.tasks.size() == offsets.size() + 1);
+    }
+  }
+}
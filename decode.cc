@@ -1,83 +1,509 @@
-// decode an arbitrary input from 1-byte Huffman coding and output the result
+// decode an arbitrary input from 1-byte or 2-byte Huffman coding and output the result
 
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
+#include <exception>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <fmt/printf.h>
 
-#include "bitstream.h"
+#include "bitreader.h"
+#include "bounded_queue.h"
+#include "checkpoints.h"
+#include "container.h"
+#include "decoder.h"
+#include "dictionary.h"
+#include "file_io.h"
 #include "huffman.h"
+#include "stats.h"
+#include "streaming.h"
+#include "thread_pool.h"
 
 
-int main(int argc, const char* argv[]) {
-  // no need to synchronise the C++ I/O streams with the C I/O streams
-  std::ios::sync_with_stdio(false);
+// decode an input encoded with a single canonical Huffman coding, using `decoder` for the decoding tables; if the input has
+// checkpoints, the parts between them are decoded by `threads` threads
+template <typename Decoder>
+int decode_single_table(uint8_t const* input_data, size_t input_size, const char* output_name, Decoder& decoder, unsigned int threads) {
+  using alphabet_type = typename Decoder::alphabet_type;
 
-  // stream for the input data
-  std::istream* in;
-  if (argc <= 1 or strcmp(argv[1], "-") == 0) {
-    // reopen cin/stdin in binary mode
-    assert(freopen(nullptr, "rb", stdin));
-    in = &std::cin;
-  } else {
-    // open the file given on the commmand line argument
-    in = new std::ifstream(argv[1], std::ios::in | std::ios::binary);
+  // read the input buffer as a bitstream, without copying it
+  bitreader decoding_buffer(input_data, input_size * 8);
+
+  // deserialise the canonical Huffman coding from the input, and the checkpoints that follow it
+  bool checkpointed = checkpoints::has_checkpoints(input_data, input_size);
+  if (checkpointed) {
+    decoding_buffer.skip(64);
+  }
+  typename Decoder::encoding_type encoding;
+  if (not encoding.deserialise(decoding_buffer)) {
+    std::cerr << "the input is corrupted: invalid coding" << std::endl;
+    return 1;
+  }
+  uint64_t interval = 0;
+  std::vector<uint64_t> offsets;
+  if (checkpointed and not checkpoints::read(decoding_buffer, encoding, interval, offsets)) {
+    std::cerr << "the input is corrupted: invalid checkpoints" << std::endl;
+    return 1;
+  }
+
+  // cut the bitstream to the size of the encoded message
+  uint64_t message_begin = decoding_buffer.tellg();
+  if (decoding_buffer.size() - message_begin < encoding.encoded_size_) {
+    std::cerr << "the input is truncated" << std::endl;
+    return 1;
+  }
+  decoding_buffer.truncate(message_begin + encoding.encoded_size_);
+
+  // every symbol takes at least one bit, so a larger size comes from a corrupted header, and must not be allocated
+  if (encoding.original_size_ > encoding.encoded_size_) {
+    std::cerr << "the input is corrupted: invalid message size" << std::endl;
+    return 1;
   }
 
-  // stream for the output data
-  std::ostream* out;
-  if (argc <= 2 or strcmp(argv[2], "-") == 0) {
-    // reopen cout/stdout in binary mode
-    assert(freopen(nullptr, "rb", stdout));
-    out = &std::cout;
+  // build the decoding tables for the canonical Huffman coding
+  decoder.build(encoding);
+
+  // the size of the output is known in advance, so the output file can be mapped in memory and written directly
+  output_file output;
+  std::vector<alphabet_type> output_buffer;
+  bool mapped = output.open_mapped(output_name, encoding.original_size_ * sizeof(alphabet_type));
+  if (not mapped) {
+    if (not output.open(output_name)) {
+      std::cerr << "cannot open the output file " << output_name << std::endl;
+      return 1;
+    }
+    output_buffer.resize(encoding.original_size_);
+  }
+  alphabet_type* output_data = mapped ? reinterpret_cast<alphabet_type*>(output.data()) : output_buffer.data();
+
+  // decode the input according to the Huffman coding, from all the checkpoints at the same time if there are any
+  size_t decoded;
+  if (checkpointed and threads > 1) {
+    thread_pool pool(threads);
+    decoded = checkpoints::decode(decoding_buffer, decoder, interval, offsets, output_data, encoding.original_size_, pool);
   } else {
-    out = new std::ofstream(argv[2], std::ios::out | std::ios::binary);
+    decoded = decoder.decode(decoding_buffer, output_data, encoding.original_size_);
+  }
+  if (decoded != encoding.original_size_) {
+    std::cerr << "the input is corrupted: decoded " << decoded << " out of " << encoding.original_size_ << " symbols" << std::endl;
   }
 
-  // buffer the input data
-  std::vector<uint8_t> input_buffer(std::istreambuf_iterator<char>(*in), {});
+  if (mapped) {
+    output.truncate(decoded * sizeof(alphabet_type));
+  } else if (not output.write(output_buffer.data(), decoded * sizeof(alphabet_type))) {
+    std::cerr << "cannot write the output file " << output_name << std::endl;
+    return 1;
+  }
+  /*
+  std::cerr << "input buffer size:  " << input_size << " bytes" << std::endl;
+  std::cerr << "output buffer size: " << decoded << " " << Decoder::encoding_type::alphabet_bits << "-bit characters" << std::endl;
+  */
+  return (output.flush() and decoded == encoding.original_size_) ? 0 : 1;
+}
 
-  // close the input stream
-  if (in != &std::cin) {
-    delete in;
+
+// decode an input encoded as a sequence of blocks, using `threads` threads and the pre-trained tables from
+// `dictionaries`; the blocks are written in order, with at most `window` decoded blocks waiting to be written at any time
+int decode_blocks(input_file& input, uint64_t block_size, const char* output_name, huffman_decoder const& prototype, dictionary::cache const& dictionaries,
+                  unsigned int threads, unsigned int window) {
+  // if the input is memory-mapped, the size of the output can be computed in advance from the block headers, so the output
+  // file can be mapped in memory and written directly
+  output_file output;
+  uint64_t output_size = 0;
+  bool mapped = false;
+  if (input.mapped()) {
+    if (not container::scan_blocks(input.data(), input.size(), output_size)) {
+      std::cerr << "the input is corrupted" << std::endl;
+      return 1;
+    }
+    mapped = output.open_mapped(output_name, output_size);
+  }
+  if (not mapped and not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
   }
 
-  // copy the input buffer to a bitstream
-  bitstream decoding_buffer;
-  decoding_buffer.from_bytes(input_buffer);
+  // the blocks go through a pipeline of three stages, so that reading, decoding and writing overlap: a reader thread reads the
+  // next blocks, this thread submits them to be decoded in parallel, and a writer thread writes them in order; the queues between
+  // the stages bound the number of blocks in memory, and each stage stops the others after an error
+  struct block {
+    container::block_header header;
+    std::vector<uint8_t> payload;  // the payload of the block, unless the input is memory-mapped
+    uint8_t const* data;
+    uint8_t* out;                  // where to decode the block in the mapped output, or nullptr
+  };
+  bounded_queue<block> blocks(2);
+  std::string read_error;
+  std::thread reader([&]() {
+    uint64_t offset = 0;
+    while (true) {
+      block next;
+      uint8_t const* data;
+      if (input.read(container::block_header_size, data) != container::block_header_size) {
+        read_error = "the input is truncated";
+        break;
+      }
+      next.header = container::read_block_header(data);
+      container::block_header const& header = next.header;
+      if (header.type == container::block_type::end_of_stream) {
+        break;
+      }
+      if (header.symbols > block_size or (mapped and header.symbols > output_size - offset)) {
+        read_error = "the input is corrupted";
+        break;
+      }
 
-  // deserialise the canonical Huffman coding from the input
-  huffman_encoding encoding;
-  encoding.deserialise(decoding_buffer);
+      // a memory-mapped input can be decoded in place, while a stream needs a buffer for each block
+      if (input.mapped()) {
+        if (input.read(header.payload_size, next.data) != header.payload_size) {
+          read_error = "the input is truncated";
+          break;
+        }
+      } else {
+        if (header.payload_size > container::max_block_payload_size(header.symbols)) {
+          read_error = "the input is corrupted";
+          break;
+        }
+        // the bound follows the block size in the container header, so a corrupted header may still ask for more memory than
+        // is available
+        try {
+          next.payload.resize(header.payload_size);
+        } catch (std::bad_alloc const&) {
+          read_error = "cannot allocate the input buffer";
+          break;
+        }
+        if (input.read_into(next.payload.data(), header.payload_size) != header.payload_size) {
+          read_error = "the input is truncated";
+          break;
+        }
+        next.data = next.payload.data();
+      }
+      if (header.type == container::block_type::huffman_dictionary and header.payload_size >= sizeof(uint64_t)) {
+        uint64_t id;
+        std::memcpy(&id, next.data, sizeof(id));
+        if (not dictionaries.find(id)) {
+          read_error = fmt::sprintf("the input references the unknown dictionary %016x", id);
+          break;
+        }
+      }
+      next.out = mapped ? output.data() + offset : nullptr;
+      offset += header.symbols;
+      if (not blocks.push(std::move(next))) {
+        break;
+      }
+    }
+    blocks.close();
+  });
 
-  // cut the bitstream to the size of the encoded message
-  assert(decoding_buffer.size() >= encoding.header_size_ + encoding.encoded_size_);
-  decoding_buffer.resize(encoding.header_size_ + encoding.encoded_size_);
+  // result of decoding a block: its validity, and the decoded symbols unless they have been written to the mapped output
+  struct decoded_block {
+    bool valid = false;
+    std::vector<uint8_t> data;
+  };
+  bounded_queue<std::future<decoded_block>> pending(window);
+  std::string write_error;
+  std::thread writer([&]() {
+    while (auto result = pending.pop()) {
+      // the tasks report their errors as invalid blocks, but an exception must not escape this thread either
+      decoded_block block;
+      try {
+        block = result->get();
+      } catch (std::exception const&) {
+        block.valid = false;
+      }
+      if (not block.valid) {
+        write_error = "the input is corrupted";
+      } else if (not mapped and not output.write(block.data.data(), block.data.size())) {
+        write_error = fmt::sprintf("cannot write the output file %s", output_name);
+      }
+      if (not write_error.empty()) {
+        pending.close();
+        blocks.close();
+        break;
+      }
+    }
+  });
 
-  // decode the input according to the Huffman coding
-  std::vector<uint8_t> output_buffer;
-  output_buffer.reserve(encoding.original_size_);
-  uint8_t byte;
-  while (encoding.decode(decoding_buffer, byte)) {
-    output_buffer.push_back(byte);
+  // decode the blocks in parallel; the repeat blocks wait for the decoding tables of the last block that carried a coding, and
+  // then share them
+  using tables = std::shared_ptr<huffman_decoder const>;
+  std::shared_future<tables> previous;
+  {
+    thread_pool pool(threads > 1 ? threads : 0);
+    while (auto item = blocks.pop()) {
+      std::promise<tables> current;
+      std::shared_future<tables> last = previous;
+      if (container::carries_coding(item->header.type)) {
+        previous = current.get_future().share();
+      }
+      // the task never throws, and always provides the tables to the next repeat blocks, so that a block that cannot be decoded
+      // or allocated only makes itself and the blocks that depend on it invalid
+      auto task = [next = std::move(*item), &prototype, &dictionaries, last, current = std::move(current)]() mutable {
+        decoded_block block;
+        container::block_header const& header = next.header;
+        tables decoded = nullptr;
+        try {
+          uint8_t* out = next.out;
+          if (not out) {
+            block.data.resize(header.symbols);
+            out = block.data.data();
+          }
+          if (header.type == container::block_type::huffman_repeat) {
+            tables decoder = last.valid() ? last.get() : nullptr;
+            block.valid = decoder and container::decode_repeat_block(header, next.data, out, *decoder);
+          } else {
+            auto decoder = std::make_shared<huffman_decoder>(prototype);
+            block.valid = container::decode_block(header, next.data, out, *decoder, &dictionaries);
+            if (block.valid) {
+              decoded = std::move(decoder);
+            }
+          }
+        } catch (std::exception const&) {
+          block.valid = false;
+          block.data.clear();
+        }
+        if (header.type != container::block_type::huffman_repeat) {
+          current.set_value(decoded);
+        }
+        return block;
+      };
+      if (not pending.push(pool.submit(std::move(task)))) {
+        break;
+      }
+    }
+    pending.close();
+    reader.join();
+    writer.join();
+  }
+  if (not write_error.empty() or not read_error.empty()) {
+    std::cerr << (write_error.empty() ? read_error : write_error) << std::endl;
+    return 1;
   }
 
-  out->write((const char*) output_buffer.data(), output_buffer.size());
-  out->flush();
-  /*
-  std::cerr << "input buffer size:  " << input_buffer.size() << " " << huffman_encoding::alphabet_bits << "-bit characters" << std::endl;
-  std::cerr << "output buffer size: " << (encoding.header_size_ + encoding.encoded_size_ + 7) / 8 << " bytes" << std::endl;
-  std::cerr << "output buffer size: " << (encoding_buffer.size() + 7) / 8  << " bytes" << std::endl;
-  std::cerr << "output buffer size: " << out->tellp() << " bytes" << std::endl;
-  */
+  return output.flush() ? 0 : 1;
+}
 
-  // close the output stream
-  if (out != &std::cout) {
-    delete out;
+
+// decode the `length` symbols starting at position `position` of a block container, or up to the end of the stream, with the
+// decoding tables of `decoder` and the pre-trained tables from `dictionaries`; only the blocks that cover the range are decoded,
+// found with the index at the end of the container, or by walking through the headers of the blocks if there is none
+int decode_range(input_file& input, const char* output_name, huffman_decoder& decoder, dictionary::cache const& dictionaries, uint64_t position, uint64_t length) {
+  if (not input.mapped()) {
+    std::cerr << "--range is only supported for regular files" << std::endl;
+    return 1;
+  }
+  std::vector<container::index_entry> entries;
+  if (not container::read_index(input.data(), input.size(), entries) and not container::build_index(input.data(), input.size(), entries)) {
+    std::cerr << "the input is corrupted" << std::endl;
+    return 1;
   }
 
+  // the end of the stream is the end of the last block, whose header has been checked by read_index() or build_index()
+  uint64_t symbols = 0;
+  if (not entries.empty()) {
+    symbols = entries.back().position + container::read_block_header(input.data() + entries.back().offset).symbols;
+  }
+  if (position > symbols) {
+    std::cerr << "the range starts past the end of the input, at " << symbols << " bytes" << std::endl;
+    return 1;
+  }
+  length = std::min(length, symbols - position);
+
+  std::vector<uint8_t> output_buffer(length);
+  if (not container::decode_range(input.data(), input.size(), entries, position, length, output_buffer.data(), decoder, &dictionaries)) {
+    std::cerr << "the input is corrupted" << std::endl;
+    return 1;
+  }
+  output_file output;
+  if (not output.open(output_name) or not output.write(output_buffer.data(), output_buffer.size())) {
+    std::cerr << "cannot write the output file " << output_name << std::endl;
+    return 1;
+  }
+  return output.flush() ? 0 : 1;
+}
+
+
+// maximum number of bytes of a stream read at once
+constexpr size_t stream_read_size = 1 << 16;
+
+// decode a stream whose first `size` bytes are in `header`, and the rest in `input`, with the pre-trained tables from
+// `dictionaries` and tables of `table_bits` bits of type `table_type` otherwise; the symbols are written as soon as each part of
+// the input has been decoded
+int decode_stream(input_file& input, uint8_t const* header, size_t size, const char* output_name, dictionary::cache const& dictionaries,
+                  int table_bits, huffman_decoder::table_type table_type) {
+  output_file output;
+  if (not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
+  }
+  streaming::decoder decoder(&dictionaries, table_bits, table_type);
+  std::vector<uint8_t> output_buffer;
+  uint8_t const* data = header;
+  while (true) {
+    output_buffer.clear();
+    decoder.feed(data, size, output_buffer);
+    if (decoder.error()) {
+      std::cerr << "the input is corrupted, or references an unknown dictionary" << std::endl;
+      return 1;
+    }
+    if (not (output.write(output_buffer.data(), output_buffer.size()) and output.flush())) {
+      std::cerr << "cannot write the output file " << output_name << std::endl;
+      return 1;
+    }
+    if (size == 0) {
+      break;
+    }
+    size = input.read_some(stream_read_size, data);
+  }
+  if (input.error() or not decoder.finished()) {
+    std::cerr << "the input is truncated" << std::endl;
+    return 1;
+  }
   return 0;
 }
+
+
+int main(int argc, const char* argv[]) {
+  // no need to synchronise the C++ I/O streams with the C I/O streams
+  std::ios::sync_with_stdio(false);
+
+  // parse the command line options, and collect the input and output file names
+  //   --single-symbol    decode one symbol per table lookup
+  //   --multi-symbol     decode multiple symbols per table lookup (default)
+  //   --table-bits N     use a lookup table indexed by N bits
+  //   --dictionary FILE  load the pre-trained table from FILE, for the blocks that reference it; can be repeated
+  //   --range P:N        decode only the N bytes starting at position P of a block container, or up to its end
+  //   -j N               decode N blocks, or the parts between the checkpoints of a single table, in parallel; use one thread
+  //                      per hardware thread if N is 0 (default: 1)
+  //   --stats            write the time spent in each phase, and the counters of the decoding, to the standard error
+  //   --stats-json       the same, as a JSON object
+  unsigned int threads = 1;
+  auto table_type = huffman_decoder::table_type::multi_symbol;
+  int table_bits = huffman_decoder::default_table_bits;
+  std::vector<const char*> dictionary_names;
+  bool range = false;
+  uint64_t range_position = 0;
+  uint64_t range_length = 0;
+  bool statistics = false, statistics_json = false;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--single-symbol") == 0) {
+      table_type = huffman_decoder::table_type::single_symbol;
+    } else if (strcmp(argv[i], "--multi-symbol") == 0) {
+      table_type = huffman_decoder::table_type::multi_symbol;
+    } else if (strcmp(argv[i], "--table-bits") == 0 and i + 1 < argc) {
+      table_bits = std::atoi(argv[++i]);
+      if (table_bits <= 0 or table_bits > huffman_decoder::max_table_bits) {
+        std::cerr << "invalid number of table bits: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--dictionary") == 0 and i + 1 < argc) {
+      dictionary_names.push_back(argv[++i]);
+    } else if (strcmp(argv[i], "--range") == 0 and i + 1 < argc) {
+      char* separator;
+      char* end;
+      range_position = std::strtoull(argv[++i], &separator, 10);
+      range_length = *separator == ':' ? std::strtoull(separator + 1, &end, 10) : 0;
+      if (separator == argv[i] or *separator != ':' or end == separator + 1 or *end != '\0') {
+        std::cerr << "invalid range: " << argv[i] << std::endl;
+        return 1;
+      }
+      range = true;
+    } else if (strcmp(argv[i], "--stats") == 0 or strcmp(argv[i], "--stats-json") == 0) {
+      statistics = true;
+      statistics_json = strcmp(argv[i], "--stats-json") == 0;
+    } else if (strcmp(argv[i], "-j") == 0 and i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+      if (threads == 0) {
+        threads = thread_pool::hardware_threads();
+      }
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  const char* input_name = args.size() < 1 ? "-" : args[0];
+  const char* output_name = args.size() < 2 ? "-" : args[1];
+
+  // report the statistics when the decoding is done, whatever its outcome
+  stats::scoped_report report(statistics, statistics_json);
+
+  // map the input file in memory, or open it as a stream
+  input_file input;
+  if (not input.open(input_name)) {
+    std::cerr << "cannot open the input file " << input_name << std::endl;
+    return 1;
+  }
+
+  // decoder for the canonical Huffman coding, whose tables are built for each block or stream
+  huffman_decoder decoder(table_bits, table_type);
+
+  // pre-trained tables, built once and shared by all the blocks that reference them
+  dictionary::cache dictionaries(table_bits, table_type);
+  for (const char* name : dictionary_names) {
+    huffman_encoding encoding;
+    if (not dictionary::load(name, encoding)) {
+      std::cerr << "cannot read the dictionary " << name << std::endl;
+      return 1;
+    }
+    dictionaries.add(encoding);
+  }
+
+  // check if the input is a block container, or a single-table stream
+  uint8_t const* header;
+  size_t size = input.read(container::header_size, header);
+  if (streaming::is_stream(header, size)) {
+    if (range) {
+      std::cerr << "--range is only supported for block containers" << std::endl;
+      return 1;
+    }
+    return decode_stream(input, header, size, output_name, dictionaries, table_bits, table_type);
+  }
+  if (container::is_container(header, size)) {
+    if (size != container::header_size) {
+      std::cerr << "the input is truncated" << std::endl;
+      return 1;
+    }
+    if (range) {
+      return decode_range(input, output_name, decoder, dictionaries, range_position, range_length);
+    }
+    uint64_t block_size;
+    if (not container::read_header(header, block_size)) {
+      std::cerr << "the input is corrupted: invalid block size" << std::endl;
+      return 1;
+    }
+    // keep up to two blocks per thread in flight, so that the workers are not starved while the output is being written
+    return decode_blocks(input, block_size, output_name, decoder, dictionaries, threads, 2 * threads);
+  } else {
+    if (range) {
+      std::cerr << "--range is only supported for block containers" << std::endl;
+      return 1;
+    }
+    // buffer the whole input data, unless it is memory-mapped
+    uint8_t const* input_data;
+    size_t input_size = input.read_all(header, size, input_data);
+    // the number of symbols in the alphabet follows the two 64-bit sizes at the beginning of the full header, or the marker at the
+    // beginning of the compact header, after the marker of the checkpoints if there is one; an alphabet of 65536 symbols is stored
+    // as 0
+    size_t coding_offset = checkpoints::has_checkpoints(input_data, input_size) ? sizeof(checkpoints::marker) : 0;
+    size_t alphabet_offset = coding_offset + 16;
+    if (input_size >= coding_offset + sizeof(uint64_t)) {
+      uint64_t marker;
+      std::memcpy(&marker, input_data + coding_offset, sizeof(marker));
+      if (marker == huffman_encoding::compact_marker) {
+        alphabet_offset = coding_offset + 8;
+      }
+    }
+    if (input_size >= alphabet_offset + 2 and input_data[alphabet_offset] == 0 and input_data[alphabet_offset + 1] == 0) {
+      basic_huffman_decoder<basic_huffman_encoding<uint16_t>> wide_decoder(table_bits, table_type);
+      return decode_single_table(input_data, input_size, output_name, wide_decoder, threads);
+    }
+    return decode_single_table(input_data, input_size, output_name, decoder, threads);
+  }
+}
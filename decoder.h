@@ -0,0 +1,410 @@
+#ifndef decoder_h
+#define decoder_h
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitstream.h"
+#include "cpu.h"
+#include "huffman.h"
+#include "invert.h"
+#include "stats.h"
+
+/* table-driven decoder for a canonical Huffman coding
+ *
+ * The next `table_bits` bits of the stream are used as the index into a primary lookup table, that gives the decoded symbol and
+ * the length of its encoding in a single access. With the default of 11 bits the table takes 4 KiB, and stays in the L1 cache.
+ *
+ * Symbols whose encoding is longer than `table_bits` are marked with a length of 0 in the primary table, and are decoded by a
+ * canonical search: for each length L, the canonical codes of length L are consecutive, starting from first_code_[L].
+ *
+ * In the multi-symbol mode a second table holds, for each index, all the complete symbols (up to `max_symbols`) that fit in the
+ * next `table_bits` bits, and the total number of bits they use; a single lookup and skip can then decode several short codes.
+ * With the default of 11 bits the multi-symbol table takes 12 KiB.
+ *
+ * Both tables can decode from any stream that supports the peek(count, value) and skip(count) interface, like bitstream. When
+ * decoding a buffer of symbols from a bitreader, the bit buffer is used directly, with a single refill per lookup.
+ *
+ * The loops that decode a buffer of symbols from bitreaders have a variant compiled for AVX2 and BMI2, selected at run time (see
+ * cpu.h): the BMI2 shifts and masks shorten the dependency chain from one lookup to the next.
+ *
+ * The decoder is specialised on the type of the coding; huffman_decoder decodes the coding of 8-bit symbols.
+ */
+
+// type of lookup table used to decode a buffer of symbols
+enum class huffman_table_type {
+  single_symbol,  // decode one symbol per lookup
+  multi_symbol    // decode all the symbols that fit in `table_bits` bits in one lookup
+};
+
+template <typename Encoding>
+class basic_huffman_decoder {
+public:
+  using encoding_type = Encoding;
+  using alphabet_type = typename Encoding::alphabet_type;
+  using encoded_type = typename Encoding::encoded_type;
+  static constexpr int alphabet_size = Encoding::alphabet_size;
+
+  static constexpr int default_table_bits = 11;  // 2^11 entries, 2 bytes each
+  static constexpr int max_table_bits = 16;      // 2^16 entries, 2 bytes each
+  static constexpr int max_code_length = 8 * sizeof(typename encoded_type::value_type);
+
+  static constexpr int max_symbols = 4;  // maximum number of symbols decoded by a single lookup in the multi-symbol table
+
+  struct entry_type {
+    alphabet_type symbol = 0;          // decoded symbol
+    typename encoded_type::size_type size = 0;  // length of the encoding of the symbol, or 0 if it is longer than `table_bits`
+  };
+
+  struct multi_entry_type {
+    alphabet_type symbols[max_symbols] = {};  // decoded symbols
+    uint8_t count = 0;                        // number of decoded symbols, or 0 if the first encoding is longer than `table_bits`
+    uint8_t size = 0;                         // total length of the encodings of the decoded symbols
+  };
+
+  // type of lookup table used to decode a buffer of symbols
+  using table_type = huffman_table_type;
+
+  // construct a decoder with the given table configuration; build() must be called before decoding any symbol
+  explicit basic_huffman_decoder(int table_bits = default_table_bits, table_type type = table_type::single_symbol)
+      : table_bits_(table_bits), type_(type) {
+    assert(table_bits > 0 and table_bits <= max_table_bits);
+  }
+
+  // build the decoding tables from a canonical Huffman coding
+  basic_huffman_decoder(Encoding const& encoding, int table_bits = default_table_bits, table_type type = table_type::single_symbol)
+      : basic_huffman_decoder(table_bits, type) {
+    build(encoding);
+  }
+
+  // (re)build the decoding tables from a canonical Huffman coding
+  void build(Encoding const& encoding) {
+    stats::timer timer(stats::phase::tables);
+
+    // 1. count the number of symbols encoded with each length
+    std::fill(std::begin(counts_), std::end(counts_), 0);
+    max_length_ = 0;
+    for (int i = 0; i < alphabet_size; ++i) {
+      typename encoded_type::size_type size = encoding.lengths_[i];
+      assert(size <= max_code_length);
+      ++counts_[size];
+      max_length_ = std::max<int>(max_length_, size);
+    }
+
+    // 2. compute the first canonical code and the index of the first symbol of each length, ignoring unused symbols
+    typename encoded_type::value_type code = 0;
+    uint32_t index = 0;
+    counts_[0] = 0;
+    for (int size = 1; size <= max_length_; ++size) {
+      code = (code + counts_[size - 1]) << 1;
+      first_code_[size] = code;
+      first_index_[size] = index;
+      index += counts_[size];
+    }
+
+    // 3. sort the symbols by encoding length, and then by symbol, as done by build_canonical_coding()
+    uint32_t next[max_code_length + 1];
+    std::copy(std::begin(first_index_), std::end(first_index_), next);
+    for (int i = 0; i < alphabet_size; ++i) {
+      typename encoded_type::size_type size = encoding.lengths_[i];
+      if (size > 0) {
+        symbols_[next[size]++] = static_cast<alphabet_type>(i);
+      }
+    }
+
+    // 4. fill the primary table: a symbol of length L fills all the entries whose lowest L bits match its encoding
+    table_.assign(1ul << table_bits_, entry_type{});
+    for (int i = 0; i < alphabet_size; ++i) {
+      typename encoded_type::size_type size = encoding.lengths_[i];
+      if (size == 0 or size > table_bits_) {
+        continue;
+      }
+      for (size_t index = encoding.encoding_[i]; index < table_.size(); index += (1ul << size)) {
+        table_[index] = {static_cast<alphabet_type>(i), size};
+      }
+    }
+
+    // 5. fill the multi-symbol table, decoding each index with the primary table until the next encoding does not fit any more
+    if (type_ == table_type::multi_symbol) {
+      multi_table_.assign(1ul << table_bits_, multi_entry_type{});
+      for (size_t index = 0; index < multi_table_.size(); ++index) {
+        multi_entry_type& multi = multi_table_[index];
+        while (multi.count < max_symbols) {
+          entry_type const& entry = table_[index >> multi.size];
+          if (entry.size == 0 or entry.size > table_bits_ - multi.size) {
+            break;
+          }
+          multi.symbols[multi.count++] = entry.symbol;
+          multi.size += entry.size;
+        }
+      }
+    } else {
+      multi_table_.clear();
+    }
+  }
+
+  // true once build() has been called
+  bool built() const { return not table_.empty(); }
+
+  // number of bits used to index the primary table
+  int table_bits() const { return table_bits_; }
+
+  // type of lookup table used to decode a buffer of symbols
+  table_type type() const { return type_; }
+
+  // length of the longest encoding
+  int max_length() const { return max_length_; }
+
+  /// read and decode a symbol from a bit stream
+  template <typename Stream>
+  bool decode(Stream& stream, alphabet_type& symbol) const {
+    typename encoded_type::value_type value;
+    bitstream::size_type bits = stream.peek(max_code_length, value);
+    if (bits == 0) {
+      // end of stream
+      return false;
+    }
+
+    typename encoded_type::size_type size;
+    if (not lookup(value, symbol, size) or size > bits) {
+      // invalid or truncated encoding
+      return false;
+    }
+    stream.skip(size);
+    return true;
+  }
+
+  /// read and decode up to `count` symbols from a bit stream into `out`, and return the number of symbols actually decoded
+  template <typename Stream>
+  size_t decode(Stream& stream, alphabet_type* out, size_t count) const {
+    size_t decoded = 0;
+    if (type_ == table_type::multi_symbol) {
+      while (count - decoded >= max_symbols) {
+        typename encoded_type::value_type value;
+        bitstream::size_type bits = stream.peek(max_code_length, value);
+        multi_entry_type const& entry = multi_table_[value & ((1ul << table_bits_) - 1)];
+        if (entry.count == 0) {
+          // long encoding, decode a single symbol
+          if (not decode(stream, out[decoded])) {
+            return decoded;
+          }
+          ++decoded;
+          continue;
+        }
+        if (entry.size > bits) {
+          // truncated encoding, fall back to the single-symbol decoding
+          break;
+        }
+        // always copy `max_symbols` symbols, and advance by the number of symbols actually decoded
+        std::memcpy(out + decoded, entry.symbols, sizeof(entry.symbols));
+        decoded += entry.count;
+        stream.skip(entry.size);
+      }
+    }
+    // decode the remaining symbols one by one
+    while (decoded < count and decode(stream, out[decoded])) {
+      ++decoded;
+    }
+    return decoded;
+  }
+
+  /// read and decode up to `count` symbols from a bit reader into `out`, and return the number of symbols actually decoded
+  size_t decode(bitreader& stream, alphabet_type* out, size_t count) const {
+    stats::timer timer(stats::phase::coding);
+    size_t decoded = decode_any(stream, out, count);
+    stats::count(stats::counter::table_symbols, decoded);
+    return decoded;
+  }
+
+  /// read and decode `Streams` independent bit readers in lockstep, where `streams[k]` holds `count[k]` symbols to be decoded
+  /// into `out[k]`: decoding the streams in turn keeps several independent lookups in flight; return true if all the symbols
+  /// have been decoded successfully
+  template <int Streams>
+  bool decode_interleaved(bitreader* streams, alphabet_type* const* out, size_t const* count) const {
+    stats::timer timer(stats::phase::coding);
+    if (stats::enabled()) {
+      stats::count(stats::counter::table_symbols, std::accumulate(count, count + Streams, uint64_t(0)));
+    }
+#if WITHER_DISPATCH
+    if (cpu::selected() >= cpu::level::avx2) {
+      return decode_interleaved_avx2<Streams>(streams, out, count);
+    }
+#endif
+    return decode_interleaved_scalar<Streams>(streams, out, count);
+  }
+
+  // decode the symbol at the beginning of `value`, and return its length in `size`
+  bool lookup(typename encoded_type::value_type value, alphabet_type& symbol, typename encoded_type::size_type& size) const {
+    entry_type const& entry = table_[value & ((1ul << table_bits_) - 1)];
+    if (entry.size > 0) {
+      // fast path: the encoding fits in the primary table
+      symbol = entry.symbol;
+      size = entry.size;
+      return true;
+    }
+    return lookup_long(value, symbol, size);
+  }
+
+private:
+  // decode up to `count` symbols from a bit reader into `out`, directly from its bit buffer; the longest encoding must fit in the
+  // bit buffer
+  [[gnu::always_inline]] size_t decode_buffer(bitreader& stream, alphabet_type* out, size_t count) const {
+    // decode directly from the bit buffer, as long as a whole word is available in the stream; the symbols are decoded from a
+    // local copy of the reader, that the stores to `out` cannot alias, so that its state is kept in registers
+    size_t decoded = 0;
+    size_t space = (type_ == table_type::multi_symbol) ? max_symbols : 1;
+    bitreader local = stream;
+    while (count - decoded >= space and local.has_word()) {
+      size_t symbols = decode_step(local, out + decoded);
+      if (symbols == 0) {
+        stream = local;
+        return decoded;
+      }
+      decoded += symbols;
+    }
+    stream = local;
+
+    // decode the last symbols one by one, checking for the end of the stream
+    while (decoded < count and decode(stream, out[decoded])) {
+      ++decoded;
+    }
+    return decoded;
+  }
+
+  // decode `Streams` independent bit readers in lockstep, as decode_interleaved()
+  template <int Streams>
+  [[gnu::always_inline]] bool decode_interleaved_streams(bitreader* streams, alphabet_type* const* out, size_t const* count) const {
+    size_t decoded[Streams] = {};
+    if (max_length_ <= static_cast<int>(bitreader::min_bits)) {
+      // decode from local copies of the readers, as decode_buffer()
+      size_t space = (type_ == table_type::multi_symbol) ? max_symbols : 1;
+      bitreader local[Streams];
+      std::copy(streams, streams + Streams, local);
+      while (true) {
+        // check that all the streams can be decoded from their bit buffer
+        bool ready = true;
+        for (int k = 0; k < Streams; ++k) {
+          ready = ready and count[k] - decoded[k] >= space and local[k].has_word();
+        }
+        if (not ready) {
+          break;
+        }
+        for (int k = 0; k < Streams; ++k) {
+          size_t symbols = decode_step(local[k], out[k] + decoded[k]);
+          if (symbols == 0) {
+            return false;
+          }
+          decoded[k] += symbols;
+        }
+      }
+      std::copy(local, local + Streams, streams);
+    }
+    // decode the rest of each stream independently
+    for (int k = 0; k < Streams; ++k) {
+      size_t remaining = count[k] - decoded[k];
+      if (decode_any(streams[k], out[k] + decoded[k], remaining) != remaining) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // decode(bitreader&, ...) without the timer and the counter, for the callers that already account for the symbols
+  size_t decode_any(bitreader& stream, alphabet_type* out, size_t count) const {
+    if (max_length_ > static_cast<int>(bitreader::min_bits)) {
+      // the longest encodings may not fit in the bit buffer, use the generic implementation
+      return decode<bitreader>(stream, out, count);
+    }
+#if WITHER_DISPATCH
+    if (cpu::selected() >= cpu::level::avx2) {
+      return decode_buffer_avx2(stream, out, count);
+    }
+#endif
+    return decode_buffer_scalar(stream, out, count);
+  }
+
+  // the loops compiled for the baseline of the architecture; they are kept out of line, as the compiler does not keep the state
+  // of the readers in registers once they have been inlined into a larger function
+  [[gnu::noinline]] size_t decode_buffer_scalar(bitreader& stream, alphabet_type* out, size_t count) const {
+    return decode_buffer(stream, out, count);
+  }
+
+  template <int Streams>
+  [[gnu::noinline]] bool decode_interleaved_scalar(bitreader* streams, alphabet_type* const* out, size_t const* count) const {
+    return decode_interleaved_streams<Streams>(streams, out, count);
+  }
+
+#if WITHER_DISPATCH
+  // the same loops, compiled for AVX2 and BMI2
+  WITHER_TARGET_AVX2 size_t decode_buffer_avx2(bitreader& stream, alphabet_type* out, size_t count) const {
+    return decode_buffer(stream, out, count);
+  }
+
+  template <int Streams>
+  WITHER_TARGET_AVX2 bool decode_interleaved_avx2(bitreader* streams, alphabet_type* const* out, size_t const* count) const {
+    return decode_interleaved_streams<Streams>(streams, out, count);
+  }
+#endif
+
+  // decode the next symbols from the bit buffer of `stream` into `out`, that must have space for `max_symbols` symbols in the
+  // multi-symbol mode, or for one symbol otherwise; a whole word must be available in the stream, and the longest encoding must
+  // fit in the bit buffer; return the number of decoded symbols, or 0 for an invalid encoding
+  [[gnu::always_inline]] size_t decode_step(bitreader& stream, alphabet_type* out) const {
+    stream.refill();
+    typename encoded_type::value_type value = stream.peek(bitreader::min_bits);
+    if (type_ == table_type::multi_symbol) {
+      multi_entry_type const& entry = multi_table_[value & ((1ul << table_bits_) - 1)];
+      if (entry.count > 0) {
+        // always copy `max_symbols` symbols, and advance by the number of symbols actually decoded
+        std::memcpy(out, entry.symbols, sizeof(entry.symbols));
+        stream.consume(entry.size);
+        return entry.count;
+      }
+    }
+    // decode a single symbol
+    typename encoded_type::size_type size;
+    if (not lookup(value, *out, size)) {
+      return 0;
+    }
+    stream.consume(size);
+    return 1;
+  }
+
+  // slow path: canonical search for the encodings longer than `table_bits`
+  bool lookup_long(typename encoded_type::value_type value, alphabet_type& symbol, typename encoded_type::size_type& size) const {
+    // the first bit of the stream is the MSB of the canonical code
+    typename encoded_type::value_type inverted = invert_bits(value);
+    for (int length = table_bits_ + 1; length <= max_length_; ++length) {
+      typename encoded_type::value_type code = inverted >> (max_code_length - length);
+      if (code - first_code_[length] < counts_[length]) {
+        symbol = symbols_[first_index_[length] + (code - first_code_[length])];
+        size = length;
+        stats::count(stats::counter::slow_symbols, 1);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  int table_bits_;
+  table_type type_;
+  int max_length_ = 0;
+  std::vector<entry_type> table_;
+  std::vector<multi_entry_type> multi_table_;
+
+  // canonical coding, used for the encodings longer than `table_bits`
+  typename encoded_type::value_type first_code_[max_code_length + 1] = {};  // first canonical code of each length
+  uint32_t first_index_[max_code_length + 1] = {};                 // index in `symbols_` of the first symbol of each length
+  uint32_t counts_[max_code_length + 1] = {};                      // number of symbols of each length
+  alphabet_type symbols_[alphabet_size] = {};                      // symbols sorted by encoding length, and then by symbol
+};
+
+// decoder for the coding of 8-bit symbols
+using huffman_decoder = basic_huffman_decoder<huffman_encoding>;
+
+#endif  // decoder_h
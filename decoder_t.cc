@@ -0,0 +1,110 @@
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitstream.h"
+#include "bitwriter.h"
+#include "decoder.h"
+#include "huffman.h"
+
+// encode `message`, decode it with a table of `table_bits` bits, and check that the result matches the original message
+template <typename Encoding = huffman_encoding>
+void check(std::vector<typename Encoding::alphabet_type> const& message, int table_bits, huffman_decoder::table_type type = huffman_decoder::table_type::single_symbol) {
+  using symbol_type = typename Encoding::alphabet_type;
+  Encoding encoding(message.data(), message.size());
+  bitstream stream;
+  for (symbol_type symbol : message) {
+    encoding.encode(stream, symbol);
+  }
+  assert(stream.size() == encoding.encoded_size_);
+
+  basic_huffman_decoder<Encoding> decoder(encoding, table_bits, type);
+  std::vector<symbol_type> decoded;
+  if (type == huffman_decoder::table_type::single_symbol) {
+    // decode one symbol at a time
+    symbol_type symbol;
+    while (decoder.decode(stream, symbol)) {
+      decoded.push_back(symbol);
+    }
+  } else {
+    // decode the whole buffer at once
+    decoded.resize(message.size());
+    decoded.resize(decoder.decode(stream, decoded.data(), decoded.size()));
+  }
+  std::cout << "message of " << message.size() << " symbols, longest code " << decoder.max_length() << " bits, "
+            << (type == huffman_decoder::table_type::single_symbol ? "single" : "multi") << "-symbol table of " << table_bits
+            << " bits: " << (decoded == message ? "ok" : "failed") << std::endl;
+  assert(decoded == message);
+  assert(stream.tellg() == stream.size());
+
+  // decode the same message from a bitreader
+  bitwriter writer;
+  for (symbol_type symbol : message) {
+    encoding.encode(writer, symbol);
+  }
+  writer.flush();
+  std::vector<uint8_t> buffer(writer.data(), writer.data() + writer.bytes());
+  bitreader reader(buffer.data(), writer.size());
+  decoded.assign(message.size(), 0);
+  decoded.resize(decoder.decode(reader, decoded.data(), decoded.size()));
+  assert(decoded == message);
+  assert(reader.tellg() == reader.size());
+}
+
+int main(int argc, const char* argv[]) {
+  {
+    // short text message
+    const std::string text = "hello world!";
+    std::vector<uint8_t> message(text.begin(), text.end());
+    for (int table_bits : {1, 4, 8, huffman_decoder::default_table_bits}) {
+      check(message, table_bits);
+      check(message, table_bits, huffman_decoder::table_type::multi_symbol);
+    }
+  }
+
+  {
+    // Fibonacci-distributed weights, that lead to very long encodings and exercise the canonical search
+    std::vector<uint8_t> message;
+    uint64_t a = 1, b = 1;
+    for (int symbol = 0; symbol < 30; ++symbol) {
+      message.insert(message.end(), a, static_cast<uint8_t>(symbol));
+      b = a + b;
+      a = b - a;
+    }
+    for (int table_bits : {4, huffman_decoder::default_table_bits, huffman_decoder::max_table_bits}) {
+      check(message, table_bits);
+      check(message, table_bits, huffman_decoder::table_type::multi_symbol);
+    }
+  }
+
+  {
+    // 16-bit samples, with a roughly gaussian distribution over a wide range
+    std::vector<uint16_t> message;
+    for (uint32_t i = 0; i < 100000; ++i) {
+      uint32_t hash = i * 2654435761u;
+      message.push_back(static_cast<uint16_t>(30000 + (hash & 0x3ff) + ((hash >> 10) & 0x3ff) + ((hash >> 20) & 0x3ff)));
+    }
+    using encoding_type = basic_huffman_encoding<uint16_t>;
+    static_assert(encoding_type::alphabet_size == 65536 and encoding_type::alphabet_bits == 16);
+    for (int table_bits : {8, huffman_decoder::default_table_bits, huffman_decoder::max_table_bits}) {
+      check<encoding_type>(message, table_bits);
+      check<encoding_type>(message, table_bits, huffman_decoder::table_type::multi_symbol);
+    }
+  }
+
+  {
+    // a small alphabet with encodings of up to 32 bits, stored in 32-bit words
+    std::vector<uint8_t> message;
+    for (int symbol = 0; symbol < 16; ++symbol) {
+      message.insert(message.end(), 1 + symbol * symbol, static_cast<uint8_t>(symbol));
+    }
+    using encoding_type = basic_huffman_encoding<uint8_t, 16, 32>;
+    static_assert(encoding_type::alphabet_bits == 4 and sizeof(encoding_type::encoded_type::value_type) == 4);
+    for (int table_bits : {4, huffman_decoder::default_table_bits}) {
+      check<encoding_type>(message, table_bits);
+      check<encoding_type>(message, table_bits, huffman_decoder::table_type::multi_symbol);
+    }
+  }
+}
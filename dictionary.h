@@ -0,0 +1,130 @@
+#ifndef dictionary_h
+#define dictionary_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "decoder.h"
+#include "huffman.h"
+
+/* pre-trained canonical Huffman codings, shared by many messages
+ *
+ * A dictionary is a coding built offline from a training corpus, where every symbol of the alphabet is given an encoding, so that
+ * it can encode any message. The messages reference it by its identifier, a checksum of the lengths of the encodings, instead of
+ * embedding the coding itself. A dictionary file holds:
+ *
+ *   8 bytes     magic number: "wither" 0x02 0xff
+ *               the serialised canonical Huffman coding, with no encoded message
+ *
+ * The encoder and the decoder keep the dictionaries in a cache, with their coding and decoding tables ready to be used.
+ */
+
+namespace dictionary {
+
+  constexpr uint8_t magic[8] = {'w', 'i', 't', 'h', 'e', 'r', 0x02, 0xff};
+
+  // identifier of a coding: the 64-bit FNV-1a hash of the lengths of its encodings
+  inline uint64_t identifier(huffman_encoding const& encoding) {
+    uint64_t hash = 0xcbf29ce484222325ul;
+    for (auto length : encoding.lengths_) {
+      hash = (hash ^ length) * 0x100000001b3ul;
+    }
+    return hash;
+  }
+
+  // build a dictionary from the `size` symbols of the training corpus `data`, with encodings of at most `max_length` bits; the
+  // symbols that are missing from the corpus are given the longest encodings
+  inline huffman_encoding train(huffman_encoding::alphabet_type const* data, size_t size, int max_length) {
+    huffman_encoding encoding;
+    encoding.scan_input(data, size);
+    for (auto& weight : encoding.weights_) {
+      ++weight;
+    }
+    encoding.build_from_weights(max_length);
+    encoding.original_size_ = 0;
+    encoding.encoded_size_ = 0;
+    encoding.use_compact_header();
+    return encoding;
+  }
+
+  // write the dictionary `encoding` to the file `name`; return false in case of errors
+  inline bool save(const char* name, huffman_encoding const& encoding) {
+    bitwriter writer;
+    for (uint8_t byte : magic) {
+      writer.write(8, byte);
+    }
+    encoding.serialise(writer);
+    writer.flush();
+    std::ofstream file(name, std::ios::out | std::ios::binary);
+    file.write(reinterpret_cast<const char*>(writer.data()), writer.bytes());
+    return static_cast<bool>(file);
+  }
+
+  // read a dictionary from the file `name` into `encoding`; return false if the file cannot be read or is not a dictionary
+  inline bool load(const char* name, huffman_encoding& encoding) {
+    std::ifstream file(name, std::ios::in | std::ios::binary | std::ios::ate);
+    if (not file) {
+      return false;
+    }
+    std::vector<uint8_t> data(file.tellg());
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (not file or data.size() <= sizeof(magic) or std::memcmp(data.data(), magic, sizeof(magic)) != 0) {
+      return false;
+    }
+    bitreader reader(data.data() + sizeof(magic), (data.size() - sizeof(magic)) * 8);
+    if (not encoding.deserialise(reader)) {
+      return false;
+    }
+    // a dictionary must be able to encode any symbol
+    return std::count(std::begin(encoding.lengths_), std::end(encoding.lengths_), 0) == 0;
+  }
+
+  // dictionaries with their coding and decoding tables, indexed by their identifier
+  class cache {
+  public:
+    struct entry {
+      uint64_t id;
+      huffman_encoding encoding;
+      huffman_decoder decoder;
+    };
+
+    // build the decoding tables of the dictionaries with the given configuration
+    explicit cache(int table_bits = huffman_decoder::default_table_bits, huffman_decoder::table_type type = huffman_decoder::table_type::single_symbol)
+        : table_bits_(table_bits), type_(type) {}
+
+    // add the dictionary `encoding` to the cache, building its decoding tables, and return the entry
+    entry const& add(huffman_encoding const& encoding) {
+      uint64_t id = identifier(encoding);
+      auto& slot = entries_[id];
+      if (not slot) {
+        slot.reset(new entry{id, encoding, huffman_decoder(encoding, table_bits_, type_)});
+      }
+      return *slot;
+    }
+
+    // find the dictionary with the identifier `id`, or return nullptr if it is not in the cache
+    entry const* find(uint64_t id) const {
+      auto it = entries_.find(id);
+      return it == entries_.end() ? nullptr : it->second.get();
+    }
+
+    // number of dictionaries in the cache
+    size_t size() const { return entries_.size(); }
+
+  private:
+    int table_bits_;
+    huffman_decoder::table_type type_;
+    std::unordered_map<uint64_t, std::unique_ptr<entry>> entries_;
+  };
+
+}  // namespace dictionary
+
+#endif  // dictionary_h
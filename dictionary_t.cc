@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bitwriter.h"
+#include "container.h"
+#include "decoder.h"
+#include "dictionary.h"
+#include "huffman.h"
+
+int main(int argc, const char* argv[]) {
+  // train a dictionary on some text: every symbol can be encoded, even if it is not in the corpus
+  std::string corpus;
+  for (int i = 0; i < 100; ++i) {
+    corpus += "the quick brown fox jumps over the lazy dog " + std::to_string(i) + "\n";
+  }
+  huffman_encoding trained = dictionary::train(reinterpret_cast<uint8_t const*>(corpus.data()), corpus.size(), 15);
+  for (auto length : trained.lengths_) {
+    assert(length > 0 and length <= 15);
+  }
+  uint64_t id = dictionary::identifier(trained);
+  std::cout << "dictionary " << std::hex << id << std::dec << ": " << trained.header_size_ << " bits" << std::endl;
+
+  // save and load the dictionary
+  const char* name = "dictionary_t.dict";
+  bool saved = dictionary::save(name, trained);
+  assert(saved);
+  huffman_encoding loaded;
+  bool valid = dictionary::load(name, loaded);
+  assert(valid);
+  uint64_t loaded_id = dictionary::identifier(loaded);
+  assert(loaded_id == id);
+  assert(std::equal(trained.encoding_, trained.encoding_ + 256, loaded.encoding_));
+  valid = dictionary::load("dictionary_t.missing", loaded);
+  assert(not valid);
+
+  // a truncated dictionary is rejected
+  {
+    std::ifstream file(name, std::ios::in | std::ios::binary);
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::ofstream truncated(name, std::ios::out | std::ios::binary | std::ios::trunc);
+    truncated.write(data.data(), data.size() - 8);
+    truncated.close();
+    huffman_encoding partial;
+    valid = dictionary::load(name, partial);
+    assert(not valid);
+  }
+  std::remove(name);
+
+  // the cache builds the tables once for each dictionary
+  dictionary::cache dictionaries(huffman_decoder::default_table_bits, huffman_decoder::table_type::multi_symbol);
+  dictionary::cache::entry const& entry = dictionaries.add(loaded);
+  dictionary::cache::entry const& same = dictionaries.add(trained);
+  assert(&same == &entry);
+  assert(dictionaries.size() == 1);
+  dictionary::cache::entry const* found = dictionaries.find(id);
+  assert(found == &entry);
+  found = dictionaries.find(id + 1);
+  assert(found == nullptr);
+
+  // encode messages that reference the dictionary, including symbols that are not in the corpus
+  for (std::string message : {std::string(), std::string("the lazy dog"), std::string("THE QUICK BROWN FOX\x01\xff", 21), corpus}) {
+    std::vector<uint8_t> buffer(container::block_header_size + container::max_block_payload_size(message.size()));
+    bitwriter writer(buffer.data(), buffer.size());
+    container::encode_dictionary_block(reinterpret_cast<uint8_t const*>(message.data()), message.size(), entry.encoding, entry.id, writer);
+    writer.flush();
+    container::block_header header = container::read_block_header(writer.data());
+    assert(header.type == container::block_type::huffman_dictionary);
+    assert(header.symbols == message.size());
+    assert(container::block_header_size + header.payload_size == writer.bytes());
+    std::cout << "message of " << message.size() << " bytes: " << header.payload_size << " bytes" << std::endl;
+
+    std::string decoded(message.size(), '\0');
+    huffman_decoder decoder;
+    uint8_t* out = reinterpret_cast<uint8_t*>(decoded.data());
+    valid = container::decode_block(header, writer.data() + container::block_header_size, out, decoder, &dictionaries);
+    assert(valid and decoded == message);
+
+    // a block that references an unknown dictionary cannot be decoded
+    dictionary::cache empty;
+    valid = container::decode_block(header, writer.data() + container::block_header_size, out, decoder, &empty);
+    assert(not valid);
+    valid = container::decode_block(header, writer.data() + container::block_header_size, out, decoder);
+    assert(not valid);
+  }
+}
@@ -1,81 +1,624 @@
-// encode an arbitrary input via 1-byte Huffman coding and output the result
+// encode an arbitrary input via 1-byte or 2-byte Huffman coding and output the result
 
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
-#include <fstream>
+#include <exception>
+#include <future>
 #include <iostream>
+#include <new>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include <fmt/printf.h>
 
-#include "bitstream.h"
+#include "bitwriter.h"
+#include "bounded_queue.h"
+#include "checkpoints.h"
+#include "container.h"
+#include "dictionary.h"
+#include "file_io.h"
 #include "huffman.h"
+#include "stats.h"
+#include "streaming.h"
+#include "tans.h"
+#include "thread_pool.h"
 
 
-int main(int argc, const char* argv[]) {
-  // no need to synchronise the C++ I/O streams with the C I/O streams
-  std::ios::sync_with_stdio(false);
+// encode the whole input with a single canonical Huffman coding of type `Encoding`, scanning the input with `threads` threads;
+// with a `sample` stride larger than 1, the coding is built from one block out of every `sample` blocks of the input; if `compact`
+// is true, the coding is serialised with the compact header when it is smaller; with an `interval` larger than 0, a checkpoint is
+// recorded every `interval` symbols after the coding, for parallel decoding
+template <typename Encoding>
+int encode_single_table(input_file& input, const char* output_name, int max_length, unsigned int threads, size_t sample, bool compact,
+                        uint64_t interval) {
+  using alphabet_type = typename Encoding::alphabet_type;
 
-  // stream for the input data
-  std::istream* in;
-  if (argc <= 1 or strcmp(argv[1], "-") == 0) {
-    // reopen cin/stdin in binary mode
-    assert(freopen(nullptr, "rb", stdin));
-    in = &std::cin;
-  } else {
-    // open the file given on the commmand line argument
-    in = new std::ifstream(argv[1], std::ios::in | std::ios::binary);
+  // buffer the input data, unless it is memory-mapped
+  uint8_t const* input_bytes;
+  size_t input_bytes_size = input.read_all(input_bytes);
+  if (input_bytes_size % sizeof(alphabet_type) != 0) {
+    std::cerr << "the input size is not a multiple of " << sizeof(alphabet_type) << " bytes" << std::endl;
+    return 1;
   }
+  // the symbols are read in the native (little endian) byte order; both the mapped memory and the buffer are suitably aligned
+  alphabet_type const* input_data = reinterpret_cast<alphabet_type const*>(input_bytes);
+  size_t input_size = input_bytes_size / sizeof(alphabet_type);
 
-  // stream for the output data
-  std::ostream* out;
-  if (argc <= 2 or strcmp(argv[2], "-") == 0) {
-    // reopen cout/stdout in binary mode
-    assert(freopen(nullptr, "rb", stdout));
-    out = &std::cout;
+  // build the canonical Huffman coding for the input
+  Encoding encoding;
+  thread_pool pool(threads > 1 ? threads : 0);
+  if (sample > 1) {
+    encoding.scan_sample(input_data, input_size, sample);
   } else {
-    out = new std::ofstream(argv[2], std::ios::out | std::ios::binary);
+    encoding.scan_input(input_data, input_size, pool);
   }
+  encoding.build_from_weights(max_length);
 
-  // buffer the input data
-  // FIXME this needs to be rewritten to support non-8 bit characters
-  std::vector<uint8_t> input_buffer(std::istreambuf_iterator<char>(*in), {});
-
-  // close the input stream
-  if (in != &std::cin) {
-    delete in;
+  // when the coding is built from a sample, the size of the encoded message is not known in advance: encode the symbols first, in
+  // a buffer that grows with the encoded size rather than with the worst case, and write the coding with the actual size before them
+  bitwriter payload;
+  if (sample > 1) {
+    constexpr size_t chunk = 1 << 16;
+    for (size_t i = 0; i < input_size; i += chunk) {
+      encoding.encode(input_data + i, std::min(chunk, input_size - i), payload);
+    }
+    payload.flush();
+    encoding.encoded_size_ = payload.size();
+  }
+  if (compact) {
+    encoding.use_compact_header();
   }
 
-  // build the canonical Huffman coding for the input
-  huffman_encoding encoding(input_buffer.data(), input_buffer.size());
+  // the checkpoints are known before encoding the input, from the lengths of the encodings
+  std::vector<uint64_t> offsets;
+  uint64_t overhead = 0;
+  if (interval > 0) {
+    offsets = checkpoints::offsets(encoding, input_data, input_size, interval, pool);
+    overhead = checkpoints::overhead(input_size, interval);
+  }
+  size_t output_size = (overhead + encoding.header_size_ + encoding.encoded_size_ + 7) / 8;
+  output_file output;
+  bool mapped = output.open_mapped(output_name, output_size);
+  if (not mapped and not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
+  }
 
   // bitstream used to encode the input according to the canonical Huffman coding
-  bitstream encoding_buffer;
-  encoding_buffer.reserve(encoding.header_size_ + encoding.encoded_size_);
+  bitwriter encoding_buffer = mapped ? bitwriter(output.data(), output_size) : bitwriter();
+  encoding_buffer.reserve(overhead + encoding.header_size_ + encoding.encoded_size_);
 
-  // write the canonical Huffman coding to the output buffer
+  // write the canonical Huffman coding to the output buffer, between the marker and the checkpoints if there are any
+  if (interval > 0) {
+    checkpoints::write_marker(encoding_buffer);
+  }
   encoding.serialise(encoding_buffer);
+  if (interval > 0) {
+    checkpoints::write(encoding_buffer, interval, offsets);
+  }
 
-  // encode the input according to the Huffman coding
-  for (auto symbol : input_buffer) {
-    encoding.encode(encoding_buffer, symbol);
+  // encode the input according to the Huffman coding, or append the symbols already encoded
+  if (sample > 1) {
+    encoding_buffer.append(payload);
+  } else {
+    encoding.encode(input_data, input_size, encoding_buffer);
   }
 
-  std::vector<uint8_t> output_buffer = encoding_buffer.bytes();
+  // store the last, partially filled word
+  encoding_buffer.flush();
+  assert(encoding_buffer.bytes() == output_size);
 
-  out->write((const char*) output_buffer.data(), output_buffer.size());
-  out->flush();
+  if (not mapped and not output.write(encoding_buffer.data(), encoding_buffer.bytes())) {
+    std::cerr << "cannot write the output file " << output_name << std::endl;
+    return 1;
+  }
   /*
-  std::cerr << "input buffer size:  " << input_buffer.size() << " " << huffman_encoding::alphabet_bits << "-bit characters" << std::endl;
+  std::cerr << "input buffer size:  " << input_size << " " << Encoding::alphabet_bits << "-bit characters" << std::endl;
   std::cerr << "output buffer size: " << (encoding.header_size_ + encoding.encoded_size_ + 7) / 8 << " bytes" << std::endl;
   std::cerr << "output buffer size: " << (encoding_buffer.size() + 7) / 8  << " bytes" << std::endl;
-  std::cerr << "output buffer size: " << out->tellp() << " bytes" << std::endl;
   */
+  return output.flush() ? 0 : 1;
+}
+
 
-  // close the output stream
-  if (out != &std::cout) {
-    delete out;
+// encode the whole input with a single canonical Huffman coding of type `Encoding`, reading the input twice in chunks of
+// `chunk_size` bytes: once to build the coding, and once to encode the symbols, so that the memory used does not depend on the
+// size of the input; the input must be seekable, and the output is written as it is encoded
+template <typename Encoding>
+int encode_single_table_chunked(input_file& input, const char* output_name, int max_length, unsigned int threads, size_t chunk_size, bool compact) {
+  using alphabet_type = typename Encoding::alphabet_type;
+  if (not input.rewind()) {
+    std::cerr << "the input must be seekable to be encoded in chunks" << std::endl;
+    return 1;
   }
+  size_t chunk_symbols = std::max<size_t>(1, chunk_size / sizeof(alphabet_type));
+  std::vector<alphabet_type> chunk(chunk_symbols);
 
+  // read the input once to build the canonical Huffman coding
+  Encoding encoding;
+  thread_pool pool(threads > 1 ? threads : 0);
+  while (true) {
+    size_t size = input.read_into(reinterpret_cast<uint8_t*>(chunk.data()), chunk_symbols * sizeof(alphabet_type));
+    if (size % sizeof(alphabet_type) != 0) {
+      std::cerr << "the input size is not a multiple of " << sizeof(alphabet_type) << " bytes" << std::endl;
+      return 1;
+    }
+    if (size == 0) {
+      break;
+    }
+    encoding.scan_input(chunk.data(), size / sizeof(alphabet_type), pool);
+  }
+  if (input.error() or not input.rewind()) {
+    std::cerr << "error reading the input file" << std::endl;
+    return 1;
+  }
+  encoding.build_from_weights(max_length);
+  if (compact) {
+    encoding.use_compact_header();
+  }
+
+  output_file output;
+  if (not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
+  }
+
+  // read the input again to encode it, writing the whole words of the encoded chunk after each chunk, and keeping the last
+  // partially filled one for the next chunk
+  bitwriter encoding_buffer;
+  encoding.serialise(encoding_buffer);
+  uint64_t encoded = 0;
+  while (true) {
+    size_t size = input.read_into(reinterpret_cast<uint8_t*>(chunk.data()), chunk_symbols * sizeof(alphabet_type)) / sizeof(alphabet_type);
+    encoded += size;
+    encoding.encode(chunk.data(), size, encoding_buffer);
+    if (size == 0) {
+      encoding_buffer.flush();
+      if (not output.write(encoding_buffer.data(), encoding_buffer.bytes())) {
+        std::cerr << "cannot write the output file " << output_name << std::endl;
+        return 1;
+      }
+      break;
+    }
+    if (not output.write(encoding_buffer.data(), encoding_buffer.stored_bytes())) {
+      std::cerr << "cannot write the output file " << output_name << std::endl;
+      return 1;
+    }
+    encoding_buffer.drop_stored();
+  }
+  if (input.error() or encoded != encoding.original_size_) {
+    std::cerr << "the input has changed while being encoded" << std::endl;
+    return 1;
+  }
+  return output.flush() ? 0 : 1;
+}
+
+
+// encode the input as a sequence of blocks of `streams` interleaved streams, each reusing the coding of the previous one, stored
+// as it is, stored as a single symbol, or with a tANS coding if `tans` is true, when it is smaller, or with the pre-trained coding
+// `dictionary` if it is not null, using `threads` threads; the blocks are written in order, with at most `window` encoded blocks
+// waiting to be written at any time, and followed by an index of the blocks if `indexed` is true
+int encode_blocks(input_file& input, const char* output_name, int max_length, uint64_t block_size, int streams, bool tans,
+                  dictionary::cache::entry const* dictionary, unsigned int threads, unsigned int window, bool indexed) {
+  output_file output;
+  if (not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
+  }
+
+  // write the container header
+  {
+    bitwriter encoding_buffer;
+    container::write_header(encoding_buffer, block_size);
+    encoding_buffer.flush();
+    if (not output.write(encoding_buffer.data(), encoding_buffer.bytes())) {
+      std::cerr << "cannot write the output file " << output_name << std::endl;
+      return 1;
+    }
+  }
+
+  // the blocks go through a pipeline of three stages, so that reading, encoding and writing overlap: a reader thread reads the
+  // next blocks, this thread submits them to be encoded in parallel, and a writer thread writes them in order; the queues
+  // between the stages bound the number of blocks in memory
+  struct block {
+    std::vector<uint8_t> buffer;  // the symbols of the block, unless the input is memory-mapped
+    uint8_t const* data;
+    size_t size;
+  };
+  bounded_queue<block> blocks(2);
+  bounded_queue<std::future<bitwriter>> pending(window);
+  std::string read_error;
+  std::thread reader([&]() {
+    while (true) {
+      // a memory-mapped input can be encoded in place, while a stream needs a buffer for each block
+      block next;
+      if (input.mapped()) {
+        next.size = input.read(block_size, next.data);
+      } else {
+        try {
+          next.buffer.resize(block_size);
+        } catch (std::bad_alloc const&) {
+          read_error = "cannot allocate the input buffer";
+          break;
+        }
+        next.size = input.read_into(next.buffer.data(), block_size);
+        next.buffer.resize(next.size);
+        next.data = next.buffer.data();
+      }
+      if (next.size == 0 or not blocks.push(std::move(next))) {
+        break;
+      }
+    }
+    blocks.close();
+  });
+  std::string write_error;
+  container::index_builder index;
+  std::thread writer([&]() {
+    uint64_t offset = container::header_size;
+    while (auto result = pending.pop()) {
+      // a block fails to encode only if it runs out of memory, or if the block before it did
+      bitwriter encoding_buffer;
+      try {
+        encoding_buffer = result->get();
+      } catch (std::exception const& e) {
+        write_error = fmt::sprintf("cannot encode the input: %s", e.what());
+      }
+      if (write_error.empty()) {
+        encoding_buffer.flush();
+        if (indexed) {
+          index.add(container::read_block_header(encoding_buffer.data()), offset);
+          offset += encoding_buffer.bytes();
+        }
+        if (not output.write(encoding_buffer.data(), encoding_buffer.bytes())) {
+          write_error = fmt::sprintf("cannot write the output file %s", output_name);
+        }
+      }
+      if (not write_error.empty()) {
+        // stop the other stages
+        pending.close();
+        blocks.close();
+        break;
+      }
+    }
+  });
+
+  // encode the blocks in parallel; each block waits for the coding chosen by the previous one before choosing its own type, but
+  // builds its coding and encodes its symbols independently
+  using coding = std::shared_ptr<huffman_encoding const>;
+  std::shared_future<coding> previous;
+  {
+    thread_pool pool(threads > 1 ? threads : 0);
+    while (auto item = blocks.pop()) {
+      std::promise<coding> current;
+      std::shared_future<coding> chosen = current.get_future().share();
+      auto task = [next = std::move(*item), max_length, streams, tans, dictionary, previous, current = std::move(current)]() mutable {
+        bitwriter encoding_buffer;
+        if (dictionary) {
+          container::encode_dictionary_block(next.data, next.size, dictionary->encoding, dictionary->id, encoding_buffer);
+          return encoding_buffer;
+        }
+        huffman_encoding encoding;
+        encoding.scan_input(next.data, next.size);
+        coding last = previous.valid() ? previous.get() : nullptr;
+        container::block_type type = container::screen_block_type(encoding, last.get(), streams);
+        tans_encoding tans_coding;
+        if (type == container::block_type::huffman) {
+          encoding.build_from_weights(max_length);
+          encoding.use_compact_header();
+          if (tans) {
+            tans_coding.build_from_weights(encoding.weights_, encoding.original_size_);
+          }
+          type = container::choose_block_type(encoding, last.get(), streams, tans ? &tans_coding : nullptr);
+        }
+        if (container::carries_coding(type)) {
+          last = std::make_shared<huffman_encoding const>(std::move(encoding));
+        }
+        current.set_value(last);
+        container::encode_block(next.data, next.size, type, last.get(), encoding_buffer, streams, &tans_coding);
+        return encoding_buffer;
+      };
+      if (not pending.push(pool.submit(std::move(task)))) {
+        break;
+      }
+      previous = std::move(chosen);
+    }
+    pending.close();
+    reader.join();
+    writer.join();
+  }
+  if (not write_error.empty()) {
+    std::cerr << write_error << std::endl;
+    return 1;
+  }
+  if (not read_error.empty()) {
+    std::cerr << read_error << std::endl;
+    return 1;
+  }
+
+  // write the end of stream marker, and the index
+  {
+    bitwriter encoding_buffer;
+    container::write_end_of_stream(encoding_buffer);
+    if (indexed) {
+      index.write(encoding_buffer);
+    }
+    encoding_buffer.flush();
+    if (not output.write(encoding_buffer.data(), encoding_buffer.bytes())) {
+      std::cerr << "cannot write the output file " << output_name << std::endl;
+      return 1;
+    }
+  }
+
+  if (input.error()) {
+    std::cerr << "error reading the input file" << std::endl;
+    return 1;
+  }
+  return output.flush() ? 0 : 1;
+}
+
+
+// encode the input as a stream, with a coding built from its first segment, or with the pre-trained coding `dictionary` if it is
+// not null, and write a segment for the bytes available at each read, up to `flush_size` bytes, as soon as they are read
+int encode_stream(input_file& input, const char* output_name, int max_length, uint64_t flush_size, dictionary::cache::entry const* dictionary) {
+  output_file output;
+  if (not output.open(output_name)) {
+    std::cerr << "cannot open the output file " << output_name << std::endl;
+    return 1;
+  }
+  streaming::encoder encoder = dictionary ? streaming::encoder(*dictionary) : streaming::encoder(max_length);
+  bitwriter encoding_buffer;
+  while (true) {
+    uint8_t const* data;
+    size_t size = input.read_some(flush_size, data);
+    if (size == 0) {
+      encoder.finish(encoding_buffer);
+    } else {
+      encoder.push(data, size);
+      encoder.flush(encoding_buffer);
+    }
+    if (not (output.write(encoding_buffer.data(), encoding_buffer.bytes()) and output.flush())) {
+      std::cerr << "cannot write the output file " << output_name << std::endl;
+      return 1;
+    }
+    encoding_buffer.reset();
+    if (size == 0) {
+      break;
+    }
+  }
+  if (input.error()) {
+    std::cerr << "error reading the input file" << std::endl;
+    return 1;
+  }
+  return 0;
+}
+
+
+// build a dictionary from the whole input, and write it to the file `dictionary_name`
+int train_dictionary(input_file& input, const char* dictionary_name, int max_length) {
+  uint8_t const* input_data;
+  size_t input_size = input.read_all(input_data);
+  if (input.error()) {
+    std::cerr << "error reading the input file" << std::endl;
+    return 1;
+  }
+  if (not dictionary::save(dictionary_name, dictionary::train(input_data, input_size, max_length))) {
+    std::cerr << "cannot write the dictionary " << dictionary_name << std::endl;
+    return 1;
+  }
   return 0;
 }
+
+
+// parse a size in bytes, with an optional k, M or G suffix; return 0 if it is not valid
+uint64_t parse_size(const char* arg) {
+  char* suffix;
+  uint64_t size = std::strtoull(arg, &suffix, 10);
+  switch (*suffix) {
+    case 'k': size <<= 10; ++suffix; break;
+    case 'M': size <<= 20; ++suffix; break;
+    case 'G': size <<= 30; ++suffix; break;
+  }
+  return *suffix == '\0' ? size : 0;
+}
+
+
+int main(int argc, const char* argv[]) {
+  // no need to synchronise the C++ I/O streams with the C I/O streams
+  std::ios::sync_with_stdio(false);
+
+  // parse the command line options, and collect the input and output file names
+  //   --max-length N     limit the encoding of each symbol to at most N bits (default: 15, or 23 for 16-bit symbols)
+  //   --block-size N     split the input in blocks of N bytes, with an optional k, M or G suffix (default: 1M)
+  //   --streams N        split each block in N interleaved streams, from 1 to 8, for faster decoding (default: 1)
+  //   --tans             encode each block with a tANS coding instead of its Huffman coding when it is smaller, e.g. for skewed
+  //                      data where the most frequent symbol has a probability above 1/2
+  //   --index            append an index of the blocks, so that any range of the input can be decoded without the other blocks
+  //   --single-table     encode the whole input with a single table, in the original format
+  //   --stream           encode the input as a stream, writing a segment as soon as some bytes have been read, up to a block at a
+  //                      time, with the coding of the first segment or the one from --dictionary
+  //   --dictionary FILE  encode the blocks with the pre-trained table from FILE
+  //   --train FILE       build a pre-trained table from the input, and write it to FILE instead of encoding the input
+  //   --sample N         with --single-table, build the table from one block out of every N blocks of the input
+  //   --compact-header   with --single-table, write the compact header when it is smaller than the full one
+  //   --chunk-size N     with --single-table, read a seekable input twice in chunks of N bytes, with an optional k, M or G
+  //                      suffix, instead of holding it all in memory
+  //   --checkpoints N    with --single-table, record a checkpoint every N symbols, with an optional k, M or G suffix, so that
+  //                      the stream can be decoded in parallel
+  //   --symbol-bits N    with --single-table, encode the input as a sequence of 8-bit (default) or 16-bit little endian symbols
+  //   -j N               encode N blocks in parallel, or scan the input of a single table with N threads; use one thread per
+  //                      hardware thread if N is 0 (default: 1)
+  //   --stats            write the time spent in each phase, and the counters of the encoding, to the standard error
+  //   --stats-json       the same, as a JSON object
+  int max_length = 0;
+  int symbol_bits = 8;
+  unsigned int threads = 1;
+  uint64_t block_size = container::default_block_size;
+  int streams = 1;
+  bool single_table = false;
+  size_t sample = 1;
+  size_t chunk_size = 0;
+  uint64_t interval = 0;
+  bool compact = false;
+  bool indexed = false;
+  bool tans = false;
+  bool stream = false;
+  bool statistics = false, statistics_json = false;
+  const char* dictionary_name = nullptr;
+  const char* train_name = nullptr;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--max-length") == 0 and i + 1 < argc) {
+      max_length = std::atoi(argv[++i]);
+      if (max_length < huffman_encoding::alphabet_bits or max_length > huffman_encoding::max_code_length) {
+        std::cerr << "invalid maximum encoding length: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--symbol-bits") == 0 and i + 1 < argc) {
+      symbol_bits = std::atoi(argv[++i]);
+      if (symbol_bits != 8 and symbol_bits != 16) {
+        std::cerr << "invalid symbol size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--block-size") == 0 and i + 1 < argc) {
+      block_size = parse_size(argv[++i]);
+      if (block_size == 0 or block_size > container::max_block_size) {
+        std::cerr << "invalid block size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--chunk-size") == 0 and i + 1 < argc) {
+      chunk_size = parse_size(argv[++i]);
+      if (chunk_size == 0) {
+        std::cerr << "invalid chunk size: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--checkpoints") == 0 and i + 1 < argc) {
+      interval = parse_size(argv[++i]);
+      if (interval == 0) {
+        std::cerr << "invalid checkpoint interval: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--streams") == 0 and i + 1 < argc) {
+      streams = std::atoi(argv[++i]);
+      if (streams < 1 or streams > container::max_streams) {
+        std::cerr << "invalid number of streams: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--index") == 0) {
+      indexed = true;
+    } else if (strcmp(argv[i], "--tans") == 0) {
+      tans = true;
+    } else if (strcmp(argv[i], "--stats") == 0 or strcmp(argv[i], "--stats-json") == 0) {
+      statistics = true;
+      statistics_json = strcmp(argv[i], "--stats-json") == 0;
+    } else if (strcmp(argv[i], "--stream") == 0) {
+      stream = true;
+    } else if (strcmp(argv[i], "--single-table") == 0) {
+      single_table = true;
+    } else if (strcmp(argv[i], "--dictionary") == 0 and i + 1 < argc) {
+      dictionary_name = argv[++i];
+    } else if (strcmp(argv[i], "--train") == 0 and i + 1 < argc) {
+      train_name = argv[++i];
+    } else if (strcmp(argv[i], "--compact-header") == 0) {
+      compact = true;
+    } else if (strcmp(argv[i], "--sample") == 0 and i + 1 < argc) {
+      sample = std::strtoull(argv[++i], nullptr, 10);
+      if (sample == 0) {
+        std::cerr << "invalid sampling stride: " << argv[i] << std::endl;
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-j") == 0 and i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+      if (threads == 0) {
+        threads = thread_pool::hardware_threads();
+      }
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (symbol_bits != 8 and not single_table) {
+    std::cerr << "16-bit symbols are only supported with --single-table" << std::endl;
+    return 1;
+  }
+  if (max_length == 0) {
+    max_length = symbol_bits + 7;
+  } else if (max_length < symbol_bits) {
+    std::cerr << "invalid maximum encoding length for " << symbol_bits << "-bit symbols: " << max_length << std::endl;
+    return 1;
+  }
+  const char* input_name = args.size() < 1 ? "-" : args[0];
+  const char* output_name = args.size() < 2 ? "-" : args[1];
+
+  if (indexed and single_table) {
+    std::cerr << "--index is only supported without --single-table" << std::endl;
+    return 1;
+  }
+  if (stream and (single_table or tans or indexed or streams > 1)) {
+    std::cerr << "--stream is only supported without --single-table, --tans, --index or --streams" << std::endl;
+    return 1;
+  }
+  if (tans and (single_table or dictionary_name)) {
+    std::cerr << "--tans is only supported without --single-table or --dictionary" << std::endl;
+    return 1;
+  }
+  if (dictionary_name and single_table) {
+    std::cerr << "--dictionary is only supported without --single-table" << std::endl;
+    return 1;
+  }
+  if ((sample > 1 or compact) and not single_table) {
+    std::cerr << "--sample and --compact-header are only supported with --single-table" << std::endl;
+    return 1;
+  }
+  if (chunk_size > 0 and (not single_table or sample > 1)) {
+    std::cerr << "--chunk-size is only supported with --single-table, and without --sample" << std::endl;
+    return 1;
+  }
+  if (interval > 0 and (not single_table or sample > 1 or chunk_size > 0)) {
+    std::cerr << "--checkpoints is only supported with --single-table, and without --sample or --chunk-size" << std::endl;
+    return 1;
+  }
+
+  // report the statistics when the encoding is done, whatever its outcome
+  stats::scoped_report report(statistics, statistics_json);
+
+  // map the input file in memory, or open it as a stream; a chunked input is always read as a stream
+  input_file input;
+  if (not input.open(input_name, chunk_size == 0)) {
+    std::cerr << "cannot open the input file " << input_name << std::endl;
+    return 1;
+  }
+
+  if (train_name) {
+    return train_dictionary(input, train_name, max_length);
+  }
+  if (single_table) {
+    if (chunk_size > 0) {
+      if (symbol_bits == 16) {
+        return encode_single_table_chunked<basic_huffman_encoding<uint16_t>>(input, output_name, max_length, threads, chunk_size, compact);
+      }
+      return encode_single_table_chunked<huffman_encoding>(input, output_name, max_length, threads, chunk_size, compact);
+    }
+    if (symbol_bits == 16) {
+      return encode_single_table<basic_huffman_encoding<uint16_t>>(input, output_name, max_length, threads, sample, compact, interval);
+    }
+    return encode_single_table<huffman_encoding>(input, output_name, max_length, threads, sample, compact, interval);
+  } else {
+    dictionary::cache dictionaries;
+    dictionary::cache::entry const* dictionary = nullptr;
+    if (dictionary_name) {
+      huffman_encoding encoding;
+      if (not dictionary::load(dictionary_name, encoding)) {
+        std::cerr << "cannot read the dictionary " << dictionary_name << std::endl;
+        return 1;
+      }
+      dictionary = &dictionaries.add(encoding);
+    }
+    if (stream) {
+      return encode_stream(input, output_name, max_length, block_size, dictionary);
+    }
+    // keep up to two blocks per thread in flight, so that the workers are not starved while the output is being written
+    return encode_blocks(input, output_name, max_length, block_size, streams, tans, dictionary, threads, 2 * threads, indexed);
+  }
+}
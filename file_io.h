@@ -0,0 +1,229 @@
+#ifndef file_io_h
+#define file_io_h
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "mapped_file.h"
+#include "stats.h"
+
+/* input and output files for the command line tools
+ *
+ * Regular files are memory-mapped when possible; "-" means the standard input or output, and anything that cannot be mapped
+ * (pipes, terminals, character devices, ...) is accessed through the C++ I/O streams.
+ *
+ * The reads and writes are timed as the read and write phases of the statistics, with the bytes read and written; the pages of
+ * a mapped file are only read or written when they are accessed, i.e. by the phases that use them.
+ */
+
+class input_file {
+public:
+  // open the file `name`, or the standard input for "-", memory-mapping it unless `map` is false; return false if the file cannot
+  // be opened
+  bool open(const char* name, bool map = true) {
+    if (map and strcmp(name, "-") != 0) {
+      mapped_ = mapped_file::open_read(name);
+    }
+    if (mapped_.valid()) {
+      return true;
+    }
+    if (strcmp(name, "-") == 0) {
+      // reopen cin/stdin in binary mode
+      if (not freopen(nullptr, "rb", stdin)) {
+        return false;
+      }
+      // do not flush cout before each read from cin, as the output may be written by another thread
+      std::cin.tie(nullptr);
+      stream_ = &std::cin;
+    } else {
+      owned_ = std::make_unique<std::ifstream>(name, std::ios::in | std::ios::binary);
+      stream_ = owned_.get();
+    }
+    return static_cast<bool>(*stream_);
+  }
+
+  // true if the input has been memory-mapped
+  bool mapped() const { return mapped_.valid(); }
+
+  // access the whole memory-mapped input
+  uint8_t const* data() const { return mapped_.data(); }
+  size_t size() const { return mapped_.size(); }
+
+  // read the next `size` bytes, or up to the end of the input; return the number of bytes actually read, and a pointer to them
+  // in `data`, valid until the next read
+  size_t read(size_t size, uint8_t const*& data) {
+    stats::timer timer(stats::phase::read);
+    if (mapped()) {
+      size = std::min(size, mapped_.size() - offset_);
+      data = mapped_.data() + offset_;
+    } else {
+      buffer_.resize(size);
+      stream_->read(reinterpret_cast<char*>(buffer_.data()), size);
+      size = stream_->gcount();
+      data = buffer_.data();
+    }
+    offset_ += size;
+    stats::count(stats::counter::bytes_in, size);
+    return size;
+  }
+
+  // read at most `size` bytes like read(), but only waiting for the first one, so that the bytes of a pipe are processed as soon as
+  // they are written
+  size_t read_some(size_t size, uint8_t const*& data) {
+    if (not mapped()) {
+      std::streamsize available = stream_->rdbuf()->in_avail();
+      size = std::min<size_t>(size, std::max<std::streamsize>(available, 1));
+    }
+    return read(size, data);
+  }
+
+  // read the next `size` bytes, or up to the end of the input, into `buffer`; return the number of bytes actually read
+  size_t read_into(uint8_t* buffer, size_t size) {
+    uint8_t const* data;
+    if (mapped()) {
+      size = read(size, data);
+      std::memcpy(buffer, data, size);
+      return size;
+    }
+    stats::timer timer(stats::phase::read);
+    stream_->read(reinterpret_cast<char*>(buffer), size);
+    size = stream_->gcount();
+    offset_ += size;
+    stats::count(stats::counter::bytes_in, size);
+    return size;
+  }
+
+  // read the rest of the input; return the number of bytes actually read, and a pointer to them in `data`
+  size_t read_all(uint8_t const*& data) {
+    if (mapped()) {
+      return read(mapped_.size() - offset_, data);
+    }
+    stats::timer timer(stats::phase::read);
+    buffer_.assign(std::istreambuf_iterator<char>(*stream_), {});
+    data = buffer_.data();
+    offset_ += buffer_.size();
+    stats::count(stats::counter::bytes_in, buffer_.size());
+    return buffer_.size();
+  }
+
+  // read the rest of the input, prepending `size` bytes from `prefix`
+  size_t read_all(uint8_t const* prefix, size_t size, uint8_t const*& data) {
+    if (mapped()) {
+      // the prefix is expected to be the data before the current offset
+      data = mapped_.data() + offset_ - size;
+      stats::count(stats::counter::bytes_in, mapped_.size() - offset_);
+      size += mapped_.size() - offset_;
+      offset_ = mapped_.size();
+      return size;
+    }
+    stats::timer timer(stats::phase::read);
+    std::vector<uint8_t> buffer(prefix, prefix + size);
+    buffer.insert(buffer.end(), std::istreambuf_iterator<char>(*stream_), {});
+    buffer_ = std::move(buffer);
+    data = buffer_.data();
+    offset_ += buffer_.size() - size;
+    stats::count(stats::counter::bytes_in, buffer_.size() - size);
+    return buffer_.size();
+  }
+
+  // go back to the beginning of the input, to read it again; return false if the input is not seekable, like a pipe
+  bool rewind() {
+    offset_ = 0;
+    if (mapped()) {
+      return true;
+    }
+    stream_->clear();
+    return static_cast<bool>(stream_->seekg(0));
+  }
+
+  // number of bytes read so far
+  size_t tell() const { return offset_; }
+
+  // true if there was an I/O error
+  bool error() const { return stream_ and stream_->bad(); }
+
+private:
+  mapped_file mapped_;
+  std::istream* stream_ = nullptr;
+  std::unique_ptr<std::istream> owned_;
+  std::vector<uint8_t> buffer_;
+  size_t offset_ = 0;
+};
+
+
+class output_file {
+public:
+  // open the file `name`, or the standard output for "-", for writing through a stream; return false if it cannot be opened
+  bool open(const char* name) {
+    name_ = name;
+    if (strcmp(name, "-") == 0) {
+      // reopen cout/stdout in binary mode
+      if (not freopen(nullptr, "wb", stdout)) {
+        return false;
+      }
+      stream_ = &std::cout;
+    } else {
+      owned_ = std::make_unique<std::ofstream>(name, std::ios::out | std::ios::binary);
+      stream_ = owned_.get();
+    }
+    return static_cast<bool>(*stream_);
+  }
+
+  // try to create the regular file `name` with a size of `size` bytes, and map it in memory; return false if it is not
+  // possible, in which case open() can be used instead
+  bool open_mapped(const char* name, size_t size) {
+    name_ = name;
+    if (strcmp(name, "-") != 0) {
+      mapped_ = mapped_file::open_write(name, size);
+    }
+    return mapped_.valid();
+  }
+
+  // true if the output has been memory-mapped
+  bool mapped() const { return mapped_.valid(); }
+
+  // access the mapped memory
+  uint8_t* data() { return mapped_.data(); }
+
+  // shrink the memory-mapped output to `size` bytes
+  void truncate(size_t size) { mapped_.truncate(size); }
+
+  // write `size` bytes from `data`; return false in case of errors
+  bool write(void const* data, size_t size) {
+    stats::timer timer(stats::phase::write);
+    stream_->write(static_cast<const char*>(data), size);
+    stats::count(stats::counter::bytes_out, size);
+    return static_cast<bool>(*stream_);
+  }
+
+  // flush the output, whose size is counted here if it is memory-mapped, as it is then only flushed once at the end; return false
+  // in case of errors
+  bool flush() {
+    stats::timer timer(stats::phase::write);
+    if (mapped()) {
+      stats::count(stats::counter::bytes_out, mapped_.size());
+    }
+    if (stream_) {
+      stream_->flush();
+      return static_cast<bool>(*stream_);
+    }
+    return true;
+  }
+
+  // name of the output file
+  const char* name() const { return name_; }
+
+private:
+  const char* name_ = nullptr;
+  mapped_file mapped_;
+  std::ostream* stream_ = nullptr;
+  std::unique_ptr<std::ostream> owned_;
+};
+
+#endif  // file_io_h
@@ -0,0 +1,120 @@
+#ifndef histogram_h
+#define histogram_h
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <vector>
+
+#include "thread_pool.h"
+
+/* byte histogram
+ *
+ * Incrementing a single table of counters one byte at a time is limited by the store-to-load forwarding of the counters: on a
+ * run of the same byte, each increment has to wait for the previous one. The kernel below spreads the counts over
+ * `histogram_tables` sub-histograms, so that the consecutive bytes of each word update independent counters, and merges them at
+ * the end.
+ *
+ * The bytes are loaded one 64-bit word at a time, and the counters use 32 bits to halve the cache footprint of the
+ * sub-histograms; they are added to the caller's 64-bit counters after each chunk of `histogram_chunk` bytes, before they can
+ * overflow. The increments are scattered loads and stores, that wider vectors do not speed up, so there is no variant of this
+ * kernel for a newer instruction set.
+ *
+ * Large inputs can also be split across the threads of a pool, each counting its part in a separate histogram.
+ */
+
+// little endian implementation: the bytes of each word are extracted starting from the LSB
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "histogram assumes a little endian architecture"
+#endif
+
+constexpr int histogram_tables = 8;                  // number of sub-histograms
+constexpr size_t histogram_chunk = size_t(1) << 31;  // number of bytes counted before merging the sub-histograms
+constexpr size_t histogram_part = size_t(1) << 20;   // smallest number of bytes counted by each thread
+
+namespace detail {
+
+  // count the 8 bytes of `word` in the sub-histograms
+  inline void histogram_word(uint32_t (*counts)[256], uint64_t word) {
+    ++counts[0][word & 0xff];
+    ++counts[1][(word >> 8) & 0xff];
+    ++counts[2][(word >> 16) & 0xff];
+    ++counts[3][(word >> 24) & 0xff];
+    ++counts[4][(word >> 32) & 0xff];
+    ++counts[5][(word >> 40) & 0xff];
+    ++counts[6][(word >> 48) & 0xff];
+    ++counts[7][word >> 56];
+  }
+
+  // count the `size` bytes of `data` in the sub-histograms; `size` must not be larger than `histogram_chunk`
+  inline void histogram_chunk(uint32_t (*counts)[256], uint8_t const* data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      histogram_word(counts, word);
+    }
+    for (; i < size; ++i) {
+      ++counts[0][data[i]];
+    }
+  }
+
+}  // namespace detail
+
+// add the number of occurrences of each byte value in the `size` bytes of `data` to `weights`
+template <typename Weight>
+void histogram(uint8_t const* data, size_t size, Weight* weights) {
+  // small inputs are not worth clearing and merging the sub-histograms
+  if (size < 8 * 256) {
+    for (size_t i = 0; i < size; ++i) {
+      ++weights[data[i]];
+    }
+    return;
+  }
+  uint32_t counts[histogram_tables][256];
+  while (size > 0) {
+    size_t chunk = size < histogram_chunk ? size : histogram_chunk;
+    std::memset(counts, 0, sizeof(counts));
+    detail::histogram_chunk(counts, data, chunk);
+    for (int symbol = 0; symbol < 256; ++symbol) {
+      Weight weight = 0;
+      for (int table = 0; table < histogram_tables; ++table) {
+        weight += counts[table][symbol];
+      }
+      weights[symbol] += weight;
+    }
+    data += chunk;
+    size -= chunk;
+  }
+}
+
+// add the number of occurrences of each byte value in the `size` bytes of `data` to `weights`, splitting the input across the
+// threads of `pool`
+template <typename Weight>
+void histogram(uint8_t const* data, size_t size, Weight* weights, thread_pool& pool) {
+  size_t parts = std::max<size_t>(1, std::min<size_t>(pool.size(), size / histogram_part));
+  if (parts == 1) {
+    histogram(data, size, weights);
+    return;
+  }
+  size_t part = (size + parts - 1) / parts;
+  std::vector<std::future<std::vector<Weight>>> counts;
+  for (size_t offset = 0; offset < size; offset += part) {
+    counts.push_back(pool.submit([data, offset, size = std::min(part, size - offset)]() {
+      std::vector<Weight> counts(256);
+      histogram(data + offset, size, counts.data());
+      return counts;
+    }));
+  }
+  for (auto& result : counts) {
+    std::vector<Weight> counts = result.get();
+    for (int symbol = 0; symbol < 256; ++symbol) {
+      weights[symbol] += counts[symbol];
+    }
+  }
+}
+
+#endif  // histogram_h
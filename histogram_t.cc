@@ -0,0 +1,56 @@
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "histogram.h"
+
+// count the bytes one at a time
+std::vector<uint64_t> reference(std::vector<uint8_t> const& data, size_t offset, size_t size) {
+  std::vector<uint64_t> weights(256);
+  for (size_t i = offset; i < offset + size; ++i) {
+    ++weights[data[i]];
+  }
+  return weights;
+}
+
+int main(int argc, const char* argv[]) {
+  std::mt19937 random(42);
+  std::vector<uint8_t> data(100000);
+
+  // random bytes, a run of the same byte, and a skewed distribution
+  for (int kind = 0; kind < 3; ++kind) {
+    std::geometric_distribution<int> distribution(0.2);
+    for (auto& byte : data) {
+      byte = kind == 0 ? random() : kind == 1 ? 0x42 : std::min(distribution(random), 255);
+    }
+    // different sizes and alignments, around the sizes handled by each path
+    for (size_t offset : {0, 1, 7, 31}) {
+      for (size_t size : {0, 1, 7, 8, 33, 2047, 2048, 2049, 4099, 99000}) {
+        std::vector<uint64_t> weights(256, 1);
+        histogram(data.data() + offset, size, weights.data());
+        std::vector<uint64_t> expected = reference(data, offset, size);
+        for (auto& weight : expected) {
+          ++weight;
+        }
+        assert(weights == expected);
+      }
+    }
+  }
+
+  // a parallel histogram gives the same counts, for inputs smaller and larger than the part counted by each thread
+  data.resize(5 * histogram_part + 3);
+  for (auto& byte : data) {
+    byte = random();
+  }
+  for (unsigned int threads : {0, 1, 3, 4}) {
+    thread_pool pool(threads);
+    for (size_t size : {size_t(1000), histogram_part + 1, data.size()}) {
+      std::vector<uint64_t> weights(256);
+      histogram(data.data(), size, weights.data(), pool);
+      assert(weights == reference(data, 0, size));
+    }
+  }
+  std::cout << "histogram: ok" << std::endl;
+}
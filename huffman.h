@@ -2,25 +2,139 @@
 #define huffman_h
 
 #include <algorithm>
+#include <bitset>
 #include <cassert>
-#include <queue>
+#include <limits>
+#include <memory>
 #include <vector>
 #include <string>
+#include <type_traits>
 
 //#include <fmt/printf.h>
 
 #include "bitstream.h"
+#include "bitwriter.h"
+#include "histogram.h"
 #include "invert.h"
+#include "stats.h"
+#include "thread_pool.h"
+
+namespace detail {
+
+  // number of bits needed to represent `size` different values
+  constexpr int bits_for(int size) {
+    int bits = 0;
+    while ((1 << bits) < size) {
+      ++bits;
+    }
+    return bits;
+  }
+
+  // scratch space of type T, kept on the stack if it is small enough, and allocated on the heap otherwise
+  template <typename T, bool = (sizeof(T) <= 65536)>
+  struct scratch {
+    T value;
+    T& operator*() { return value; }
+  };
+
+  template <typename T>
+  struct scratch<T, false> {
+    struct storage_type {
+      T value;
+    };
+    std::unique_ptr<storage_type> storage = std::make_unique<storage_type>();
+    T& operator*() { return storage->value; }
+  };
+
+  // a stream that only counts the bits written to it
+  struct bit_counter {
+    uint64_t size = 0;
+    void write(uint64_t count, uint64_t) { size += count; }
+  };
+
+  // a stream that forwards the reads to `stream`, and records if any of them reached the end of it before reading all the requested
+  // bits, to detect a truncated header
+  template <typename Stream>
+  struct checked_reader {
+    Stream& stream;
+    bool complete = true;
+
+    template <typename T>
+    uint64_t read(uint64_t count, T& value) {
+      uint64_t read = stream.read(count, value);
+      complete = complete and read == count;
+      return read;
+    }
+  };
+
+  // number of significant bits in `value`
+  inline int significant_bits(uint64_t value) { return value == 0 ? 0 : 64 - __builtin_clzll(value); }
+
+  // write `value` as the number of its significant bits, followed by the bits themselves
+  template <typename Stream>
+  void write_size(Stream& stream, uint64_t value) {
+    int bits = significant_bits(value);
+    assert(bits < 64);
+    stream.write(6, bits);
+    stream.write(bits, value);
+  }
+
+  template <typename Stream>
+  uint64_t read_size(Stream& stream) {
+    uint64_t bits = 0, value = 0;
+    stream.read(6, bits);
+    stream.read(bits, value);
+    return value;
+  }
+
+  // write `value` as an Exp-Golomb code: N zero bits, a one bit, and the N lowest bits of `value` + 1
+  template <typename Stream>
+  void write_exp_golomb(Stream& stream, uint64_t value) {
+    int bits = significant_bits(value + 1) - 1;
+    stream.write(bits, uint64_t(0));
+    stream.write(1, 1);
+    stream.write(bits, (value + 1) & ((uint64_t(1) << bits) - 1));
+  }
+
+  template <typename Stream>
+  uint64_t read_exp_golomb(Stream& stream) {
+    int bits = 0;
+    uint64_t bit = 0;
+    while (stream.read(1, bit) == 1 and bit == 0 and bits < 63) {
+      ++bits;
+    }
+    uint64_t value = 0;
+    stream.read(bits, value);
+    return ((uint64_t(1) << bits) | value) - 1;
+  }
+
+}  // namespace detail
+
+/* canonical Huffman coding of an alphabet of `AlphabetSize` symbols of type `Symbol`, with encodings of up to `MaxCodeLength`
+ * bits
+ *
+ * All the tables have a size known at compile time; when the encodings fit in 32 bits, they are stored as 32-bit values.
+ * huffman_encoding is the coding of 8-bit symbols used by the command line tools and by the container format.
+ */
+
+template <typename Symbol, int AlphabetSize = (1 << (8 * sizeof(Symbol))), int MaxCodeLength = 63>
+class basic_huffman_encoding {
+  static_assert(std::is_unsigned_v<Symbol> and sizeof(Symbol) <= 2, "the symbols must be 8-bit or 16-bit unsigned integers");
+  static_assert(AlphabetSize >= 2 and AlphabetSize <= (1 << (8 * sizeof(Symbol))), "the alphabet does not fit in the symbol type");
+  static_assert(MaxCodeLength <= 63, "the encodings are limited to 63 bits");
 
-class huffman_encoding {
 public:
 
-  using alphabet_type = uint8_t;             // type of the symbols that compose the alphabet of the input data
-  static constexpr int alphabet_bits = 8;    // number of bits needed to encode one input symbol
-  static constexpr int alphabet_size = 256;  // number of different symbols that make up the input alphabet
+  using alphabet_type = Symbol;                                           // type of the symbols that compose the alphabet of the input data
+  static constexpr int alphabet_bits = detail::bits_for(AlphabetSize);   // number of bits needed to encode one input symbol
+  static constexpr int alphabet_size = AlphabetSize;                      // number of different symbols that make up the input alphabet
+
+  static_assert(MaxCodeLength >= alphabet_bits, "the encodings cannot be shorter than the symbols");
 
   using weight_type = uint64_t;  // type used to store the weight of each symbol
 
+  static constexpr size_t sample_block_size = 4096;  // number of consecutive symbols counted by scan_sample()
+
   // According to
   //   Abu-Mostafa, Y.S. (California Institute of Technology), and R. J. McEliece, "Maximal Codeword Lengths in Huffman Codes",
   //   The Telecommunications and Data Acquisition Progress Report 42-110: April-June 1992, pp. 188-193, August 15, 1992.
@@ -45,21 +159,32 @@ public:
   // It seems safe to assume that 64 bits should suffice for all reasonable input datasets.
   //
   // A length-limited Huffman coding can be further restricted to have all symbols envoded by a smaller, fixed number of bits.
+  // get_code_lenghts_from_data(max_length) builds the optimal prefix code with this restriction, using the package-merge algorithm
+  // described in
+  //   L. L. Larmore and D. S. Hirschberg, "A fast algorithm for optimal length-limited Huffman codes",
+  //   Journal of the ACM, Volume 37, Issue 3, July 1990, pp. 464-473.
+  //
+  // Since all the symbols of the alphabet may be present in the input, the maximum length cannot be shorter than alphabet_bits.
+  //
+  // The symbols that are not present in the input (with a weight of zero) are not given an encoding, and their length is 0.
+
+  static constexpr int max_code_length = MaxCodeLength;  // maximum length of the encoding of a symbol
+  static constexpr int unused_length = 63;               // serialised length of the symbols without an encoding
 
   struct encoded_type {
-    using value_type = uint64_t;
+    using value_type = std::conditional_t<(max_code_length <= 32), uint32_t, uint64_t>;
     using size_type = uint8_t;
 
     value_type value = 0;
     size_type size = 0;
   };
 
-  std::string to_string(encoded_type::value_type value, encoded_type::size_type bits) const {
+  std::string to_string(typename encoded_type::value_type value, typename encoded_type::size_type bits) const {
     std::string out(bits + 2, '\0');
     out[0] = '0';
     out[1] = 'b';
-    for (encoded_type::size_type i = 0; i < bits; ++i) {
-      out[i + 2] = (value & (0x01 << i) ? '1' : '0');
+    for (typename encoded_type::size_type i = 0; i < bits; ++i) {
+      out[i + 2] = (value & (static_cast<typename encoded_type::value_type>(1) << i) ? '1' : '0');
     }
     return out;
   }
@@ -71,38 +196,46 @@ public:
 
 
   // default constructor: build a "neutral" Huffman coding that encodes each symbol with itself
-  huffman_encoding() {
+  basic_huffman_encoding() {
     // initialise the weights to zero, and the Huffman coding to a neutral one
     for (int i = 0; i < alphabet_size; ++i) {
       weights_[i] = 0;
       lengths_[i] = alphabet_bits;
-      encoding_[i] = invert_bits(static_cast<uint8_t>(i), alphabet_bits);
+      encoding_[i] = invert_bits(static_cast<typename encoded_type::value_type>(i), alphabet_bits);
     }
   }
 
 
-  // constructor from the full dataset
-  huffman_encoding(alphabet_type const* data, size_t size) : huffman_encoding() {
+  // constructor from the full dataset, optionally limiting the length of the encoding of each symbol to `max_length` bits
+  basic_huffman_encoding(alphabet_type const* data, size_t size, int max_length = max_code_length) : basic_huffman_encoding() {
     // scan the whole input
     scan_input(data, size);
 
+    // build the coding from the weights
+    build_from_weights(max_length);
+  }
+
+
+  // build the canonical Huffman coding from the weights collected so far, limiting the length of the encoding of each symbol to
+  // `max_length` bits
+  void build_from_weights(int max_length = max_code_length) {
     // compute the optimal code length for each symbol based on the weights
-    get_code_lenghts_from_data();
+    get_code_lenghts_from_data(max_length);
 
     // build the canonical Huffman coding from the code lengths
     build_canonical_coding();
+    stats::record_coding(weights_, lengths_, alphabet_size);
   }
 
 
   void scan_input(alphabet_type const* data, size_t size) {
+    stats::timer timer(stats::phase::scan);
+
     // count the input buffer size
     original_size_ += size;
 
     // count the occurrencies of each symbol in the input data
-    for (size_t i = 0; i < size; ++i) {
-      int symbol = data[i];
-      ++weights_[symbol];
-    }
+    count_symbols(data, size, weights_);
 
     /*
     // print the weight and frequency for the input symbols
@@ -114,71 +247,159 @@ public:
     */
   }
 
-  // compute the code length based on the weights
-  void get_code_lenghts_from_data() {
-    struct node_type {
-      node_type() = default;
-      node_type(weight_type weight) : weight(weight) {}
+  // scan the input using the threads of `pool`
+  void scan_input(alphabet_type const* data, size_t size, thread_pool& pool) {
+    if constexpr (bytes) {
+      stats::timer timer(stats::phase::scan);
+      original_size_ += size;
+      histogram(data, size, weights_, pool);
+    } else {
+      scan_input(data, size);
+    }
+  }
 
-      node_type* parent = nullptr;  // nullptr if no parent
-      weight_type weight = 0;       // cumulative weight
-      uint32_t height = 0;          // height of the node (longest distance from a leaf)
-    };
+  // scan a sample of the input: one block of `sample_block_size` symbols out of every `stride` blocks, with the weights scaled up
+  // to the size of the whole input; as the symbols that are not in the sample may still be present in the input, every symbol
+  // gets a nonzero weight, so that it can be encoded.
+  // NB: encoded_size_ is then only an estimate of the size of the encoded input
+  void scan_sample(alphabet_type const* data, size_t size, size_t stride) {
+    assert(stride >= 1);
+    stats::timer timer(stats::phase::scan);
+    original_size_ += size;
+    detail::scratch<weight_type[alphabet_size]> sample_buffer;
+    weight_type* sample = *sample_buffer;
+    std::fill(sample, sample + alphabet_size, 0);
+    weight_type sampled = 0;
+    for (size_t offset = 0; offset < size; offset += stride * sample_block_size) {
+      size_t block = std::min(sample_block_size, size - offset);
+      count_symbols(data + offset, block, sample);
+      sampled += block;
+    }
+    for (int i = 0; i < alphabet_size; ++i) {
+      weights_[i] += std::max<weight_type>(1, scale_weight(sample[i], sampled, size));
+    }
+  }
 
-    // reserve enough space for all the nodes (leaves and intermediate nodes)
-    std::vector<node_type> nodes;
-    nodes.reserve(alphabet_size * 2 - 1);
+  // scale up the weight `count` of a symbol in a sample of `sampled` symbols to an input of `size` symbols; the product is computed
+  // on 128 bits, as it overflows 64 bits for inputs of a few GB
+  static weight_type scale_weight(weight_type count, uint64_t sampled, uint64_t size) {
+    return sampled ? static_cast<weight_type>(static_cast<unsigned __int128>(count) * size / sampled) : 0;
+  }
 
-    // create the leaves
-    for (int i = 0; i < alphabet_size; ++i) {
-      nodes.emplace_back(weights_[i]);
+private:
+  // the 8-bit alphabet can be counted with the multi-table histogram kernel
+  static constexpr bool bytes = std::is_same_v<alphabet_type, uint8_t> and alphabet_size == 256;
+
+  // add the number of occurrences of each symbol in the `size` symbols of `data` to `weights`
+  static void count_symbols(alphabet_type const* data, size_t size, weight_type* weights) {
+    if constexpr (bytes) {
+      histogram(data, size, weights);
+    } else {
+      for (size_t i = 0; i < size; ++i) {
+        assert(data[i] < alphabet_size);
+        ++weights[data[i]];
+      }
     }
+  }
 
-    // use a priority queue to build up the tree
-    std::vector<node_type*> tmp;
-    tmp.reserve(alphabet_size);
+public:
+  // sort the symbols with a nonzero weight into `symbols`, by weight and then by symbol, and return their number
+  int sort_symbols_by_weight(int* symbols) const {
+    int count = 0;
     for (int i = 0; i < alphabet_size; ++i) {
-      tmp.push_back(&nodes[i]);
-    }
-    auto compare_nodes = [](node_type const* left, node_type const* right) { return left->weight == right->weight ? left->height > right->height : left->weight > right->weight; };
-    std::priority_queue queue(compare_nodes, tmp);
-    tmp.clear();
-
-    // iteratively combine the two lowest-weight nodes form the queue to create a new node with the sum of their weight
-    node_type* root;
-    while (queue.size() > 1) {
-      node_type* first = queue.top();
-      queue.pop();
-      node_type* second = queue.top();
-      queue.pop();
-      node_type* node = &nodes.emplace_back(first->weight + second->weight);
-      node->height = std::max(first->height, second->height) + 1;
-      first->parent = node;
-      second->parent = node;
-      if (queue.empty()) {
-        // the node is the root of the tree
-        root = node;
+      if (weights_[i] > 0) {
+        symbols[count++] = i;
+      }
+    }
+    std::sort(symbols, symbols + count, [this](int left, int right) {
+      return weights_[left] == weights_[right] ? left < right : weights_[left] < weights_[right];
+    });
+    return count;
+  }
+
+  // compute the code length based on the weights
+  //
+  // The lengths are computed in place over the sorted weights, without building the tree explicitly and without any memory
+  // allocation, as described in
+  //   A. Moffat and J. Katajainen, "In-place calculation of minimum-redundancy codes",
+  //   Workshop on Algorithms and Data Structures, LNCS 955, pp. 393-402, 1995.
+  void get_code_lenghts_from_data() {
+    std::fill(lengths_, lengths_ + alphabet_size, 0);
+    detail::scratch<int[alphabet_size]> symbols_buffer;
+    int* symbols = *symbols_buffer;
+    int count = sort_symbols_by_weight(symbols);
+    if (count == 0) {
+      return;
+    }
+    if (count == 1) {
+      // a single symbol still needs one bit to be encoded
+      lengths_[symbols[0]] = 1;
+      encoded_size_ += weights_[symbols[0]];
+      return;
+    }
+
+    // 1. build the tree: each internal node is stored in place of a weight that has already been used, and its weight is
+    //    replaced by the index of its parent once it has been combined into another node
+    detail::scratch<weight_type[alphabet_size]> nodes_buffer;
+    weight_type* nodes = *nodes_buffer;
+    for (int i = 0; i < count; ++i) {
+      nodes[i] = weights_[symbols[i]];
+    }
+    int root = 0;  // next internal node to be combined
+    int leaf = 2;  // next leaf to be combined
+    nodes[0] += nodes[1];
+    for (int next = 1; next < count - 1; ++next) {
+      // the first child is the lightest between the next internal node and the next leaf, preferring the leaf in case of equal
+      // weights to keep the tree shallow
+      if (leaf >= count or nodes[root] < nodes[leaf]) {
+        nodes[next] = nodes[root];
+        nodes[root++] = next;
       } else {
-        // add the intermediate node back to the queue
-        queue.push(node);
+        nodes[next] = nodes[leaf++];
+      }
+      // the same for the second child
+      if (leaf >= count or (root < next and nodes[root] < nodes[leaf])) {
+        nodes[next] += nodes[root];
+        nodes[root++] = next;
+      } else {
+        nodes[next] += nodes[leaf++];
       }
     }
-    assert(root->height <= 64);
 
-    // check that the queue is empty and the tree has the expected size
-    assert(queue.empty());
-    assert(nodes.size() == alphabet_size * 2 - 1);
+    // 2. replace the parent index of each internal node with its depth, starting from the root
+    nodes[count - 2] = 0;
+    for (int next = count - 3; next >= 0; --next) {
+      nodes[next] = nodes[nodes[next]] + 1;
+    }
 
-    // traverse the tree and count the encoding bit lengths
-    for (int i = 0; i < alphabet_size; ++i) {
-      encoded_type::size_type length = 0;
-      // start from the leaf and traverse the tree until the root
-      for (node_type const* node = &nodes[i]; node != root; node = node->parent) {
-        ++length;
+    // 3. convert the depths of the internal nodes into the depths of the leaves: the nodes available at each depth that are not
+    //    internal nodes are leaves, and they are assigned to the symbols from the heaviest to the lightest
+    int available = 1;
+    int used = 0;
+    weight_type depth = 0;
+    root = count - 2;
+    int next = count - 1;
+    while (available > 0) {
+      while (root >= 0 and nodes[root] == depth) {
+        ++used;
+        --root;
+      }
+      while (available > used) {
+        nodes[next--] = depth;
+        --available;
       }
-      lengths_[i] = length;
+      available = 2 * used;
+      ++depth;
+      used = 0;
+    }
+
+    // the lengths are not limited here, but can only exceed max_code_length for extremely skewed weights, and are then reduced by
+    // get_code_lenghts_from_data(max_length); weights that add up to less than 2^64 never build a tree deeper than 92 levels
+    for (int i = 0; i < count; ++i) {
+      assert(nodes[i] <= std::numeric_limits<typename encoded_type::size_type>::max());
+      lengths_[symbols[i]] = nodes[i];
       // count how many bits are used in total by all the symbol
-      encoded_size_ += weights_[i] * length;
+      encoded_size_ += weights_[symbols[i]] * nodes[i];
     }
 
     /*
@@ -193,15 +414,92 @@ public:
   }
 
 
+  // compute the code length based on the weights, limiting the length of the encoding of each symbol to `max_length` bits
+  void get_code_lenghts_from_data(int max_length) {
+    assert(max_length >= alphabet_bits and max_length <= max_code_length);
+    stats::timer timer(stats::phase::tree);
+
+    // build the unrestricted Huffman coding, and check if it already satisfies the length limit
+    uint64_t previous_size = encoded_size_;
+    get_code_lenghts_from_data();
+    if (*std::max_element(lengths_, lengths_ + alphabet_size) <= max_length) {
+      return;
+    }
+
+    // sort the symbols by weight
+    detail::scratch<int[alphabet_size]> symbols_buffer;
+    int* symbols = *symbols_buffer;
+    int count = sort_symbols_by_weight(symbols);
+
+    // package-merge: at each level, the list is the merge of the sorted leaves with the packages formed by pairing consecutive
+    // items from the list of the next (deeper) level; record which items of each list are leaves
+    constexpr int max_items = alphabet_size * 2 - 1;
+    detail::scratch<weight_type[max_items]> list_buffer;
+    detail::scratch<weight_type[alphabet_size]> packages_buffer;
+    detail::scratch<std::bitset<max_code_length * max_items>> is_leaf_buffer;
+    weight_type* list = *list_buffer;
+    weight_type* packages = *packages_buffer;
+    auto& is_leaf = *is_leaf_buffer;
+    size_t list_size = count;
+    for (int i = 0; i < count; ++i) {
+      list[i] = weights_[symbols[i]];
+      is_leaf[(max_length - 1) * max_items + i] = true;
+    }
+    for (int level = max_length - 2; level >= 0; --level) {
+      // pair the consecutive items from the previous list
+      size_t packages_size = list_size / 2;
+      for (size_t i = 0; i < packages_size; ++i) {
+        packages[i] = list[2 * i] + list[2 * i + 1];
+      }
+      // merge the leaves and the packages, preferring the leaves in case of equal weights
+      int leaf = 0;
+      size_t package = 0;
+      list_size = 0;
+      while (leaf < count or package < packages_size) {
+        if (package == packages_size or (leaf < count and weights_[symbols[leaf]] <= packages[package])) {
+          is_leaf[level * max_items + list_size] = true;
+          list[list_size++] = weights_[symbols[leaf++]];
+        } else {
+          list[list_size++] = packages[package++];
+        }
+      }
+    }
+
+    // select the first 2n - 2 items at the top level; each leaf selected at any level adds one bit to the length of its
+    // symbol, and each package selected at one level selects two items at the next level
+    std::fill(lengths_, lengths_ + alphabet_size, 0);
+    size_t selected = count * 2 - 2;
+    for (int level = 0; level < max_length; ++level) {
+      size_t leaves = 0;
+      for (size_t i = 0; i < selected; ++i) {
+        if (is_leaf[level * max_items + i]) {
+          // the selected leaves are always the lightest ones
+          ++lengths_[symbols[leaves++]];
+        }
+      }
+      selected = (selected - leaves) * 2;
+    }
+
+    // count how many bits are used in total by all the symbol
+    encoded_size_ = previous_size;
+    for (int i = 0; i < alphabet_size; ++i) {
+      assert((lengths_[i] > 0) == (weights_[i] > 0) and lengths_[i] <= max_length);
+      encoded_size_ += weights_[i] * lengths_[i];
+    }
+  }
+
+
   // build the canonical Huffman coding from the legths of the encoding of each symbol
   void build_canonical_coding() {
+    stats::timer timer(stats::phase::canonical);
 
     // 1. fill the symbols and their Huffman code lengths in a single variable
-    static_assert(sizeof(encoded_type::size_type) <= 2);
+    static_assert(sizeof(typename encoded_type::size_type) <= 2);
     static_assert(sizeof(alphabet_type) <= 2);
     using pair_t = uint32_t;
 
-    pair_t sortable[alphabet_size];
+    detail::scratch<pair_t[alphabet_size]> sortable_buffer;
+    pair_t* sortable = *sortable_buffer;
     for (int i = 0; i < alphabet_size; ++i) {
       sortable[i] = static_cast<uint16_t>(lengths_[i]) << 16 | static_cast<uint16_t>(static_cast<alphabet_type>(i));
     }
@@ -212,14 +510,18 @@ public:
     // 3. assign an encoding to each symbol, starting from 0
 
     alphabet_type symbol;
-    encoded_type::size_type prev_size, size;
-    encoded_type::value_type value;
+    typename encoded_type::size_type prev_size = 0, size;
+    typename encoded_type::value_type value;
     for (int i = 0; i < alphabet_size; ++i) {
       // read the symbol and the encoding legth
       symbol = static_cast<alphabet_type>(sortable[i] & 0xFFFF);
-      size = static_cast<encoded_type::size_type>((sortable[i] >> 16) & 0xFFFF);
+      size = static_cast<typename encoded_type::size_type>((sortable[i] >> 16) & 0xFFFF);
 
-      if (i == 0) {
+      if (size == 0) {
+        // unused symbol, sorted before all the others
+        encoding_[symbol] = 0;
+        continue;
+      } else if (prev_size == 0) {
         // first code point: set the Huffman coding to all 0
         value = 0;
         prev_size = size;
@@ -235,8 +537,8 @@ public:
       }
 
       // store the coding in little-endian format, with the first bit of the Huffman encoding in the LSB
-      lengths_[static_cast<uint8_t>(symbol)] = size;
-      encoding_[static_cast<uint8_t>(symbol)] = invert_bits(value, size);
+      lengths_[symbol] = size;
+      encoding_[symbol] = invert_bits(value, size);
     }
 
     /*
@@ -251,75 +553,127 @@ public:
   }
 
 
-  // serialise the canonical Huffman coding to a bit stream
-  void serialise(bitstream& stream) const {
+  // serialise the canonical Huffman coding to a bit stream, using the compact header if use_compact_header() has selected it
+  template <typename Stream>
+  void serialise(Stream& stream) const {
+    if (compact_) {
+      serialise_compact(stream);
+      return;
+    }
 
     // encode the header
     stream.write(64, header_size_ + encoded_size_);
     stream.write(64, original_size_);
 
     // encode the canonical Huffman coding
-    stream.write(16, alphabet_size);
-    for (encoded_type::size_type bits: lengths_) {
-      // 6 bit per symbol: encode the size of each symbol's coding - 1
-      stream.write(6, bits - 1);
+    // [NB: an alphabet of 65536 symbols is stored as 0]
+    stream.write(16, alphabet_size % 65536);
+    for (typename encoded_type::size_type bits: lengths_) {
+      // 6 bit per symbol: encode the size of each symbol's coding - 1, or `unused_length` for the unused symbols
+      stream.write(6, bits == 0 ? unused_length : bits - 1);
     }
 
   }
 
 
-  // deserialise the canonical Huffman coding from a bit stream
-  void deserialise(bitstream& stream) {
+  // deserialise the canonical Huffman coding from a bit stream, with either the full or the compact header; return false if the
+  // header is truncated or corrupted
+  template <typename Stream>
+  bool deserialise(Stream& stream) {
+    auto begin = stream.tellg();
 
-    // read the size (in bits) of the header and encoded message
-    uint64_t message_size;
-    stream.read(64, message_size);
+    // read the size (in bits) of the header and encoded message, or the marker of a compact header
+    uint64_t message_size = 0;
+    if (stream.read(64, message_size) != 64) {
+      return false;
+    }
+    if (message_size == compact_marker) {
+      bool valid = deserialise_compact(stream);
+      header_size_ = stream.tellg() - begin;
+      return valid;
+    }
+    compact_ = false;
+    header_size_ = full_header_size;
+    detail::checked_reader<Stream> in{stream};
 
     // read the size (in symbols) of the decoded message
-    stream.read(64, original_size_);
+    in.read(64, original_size_);
 
     // check that the alphabet size matches the Huffman coding
-    uint16_t read_alphabet_size;
-    stream.read(16, read_alphabet_size);
-    assert(alphabet_size == read_alphabet_size);
+    uint16_t read_alphabet_size = 0;
+    in.read(16, read_alphabet_size);
 
     // size of the encoded message (in bits)
     encoded_size_ = message_size - header_size_;
 
     // read the size (in bits, - 1) of each symbol's coding
-    for (encoded_type::size_type & bits: lengths_) {
-      encoded_type::size_type bits_minus_one;
-      stream.read(6, bits_minus_one);
-      bits = bits_minus_one + 1;
+    bool valid_lengths = true;
+    for (typename encoded_type::size_type & bits: lengths_) {
+      typename encoded_type::size_type bits_minus_one = 0;
+      in.read(6, bits_minus_one);
+      bits = bits_minus_one == unused_length ? 0 : bits_minus_one + 1;
+      valid_lengths = valid_lengths and bits <= max_code_length;
+    }
+    if (not in.complete or message_size < header_size_ or alphabet_size % 65536 != read_alphabet_size or not valid_lengths) {
+      return false;
     }
 
     // build the canonical Huffman coding from the legths of the encoding of each symbol
     build_canonical_coding();
+    return true;
+  }
+
+
+  // use the compact header for serialise(), if it is smaller than the full one; header_size_ is updated accordingly
+  void use_compact_header() {
+    detail::bit_counter counter;
+    serialise_compact(counter);
+    if (counter.size < full_header_size) {
+      compact_ = true;
+      header_size_ = counter.size;
+    }
   }
 
 
   /// encode and write a symbol to a bit stream
-  void encode(bitstream& stream, alphabet_type symbol) {
-    encoded_type::size_type size = lengths_[static_cast<uint8_t>(symbol)];
-    encoded_type::value_type value = encoding_[static_cast<uint8_t>(symbol)];
+  template <typename Stream>
+  void encode(Stream& stream, alphabet_type symbol) const {
+    typename encoded_type::size_type size = lengths_[symbol];
+    typename encoded_type::value_type value = encoding_[symbol];
+    assert(size > 0);
     stream.write(size, value);
   }
 
 
+  /// encode and write `size` symbols from `data` to a bit stream, with the bulk kernel of the bitwriter
+  template <typename Stream>
+  void encode(alphabet_type const* data, size_t size, Stream& stream) const {
+    stats::timer timer(stats::phase::coding);
+    if constexpr (std::is_same_v<Stream, bitwriter>) {
+      stream.write_codes(data, size, encoding_, lengths_, *std::max_element(lengths_, lengths_ + alphabet_size));
+    } else {
+      for (size_t i = 0; i < size; ++i) {
+        encode(stream, data[i]);
+      }
+    }
+  }
+
+
   /// read and decode a symbol from a bit stream
-  bool decode(bitstream& stream, alphabet_type& symbol) {
-    encoded_type::size_type bits = 8 * sizeof(encoded_type::value_type);
-    encoded_type::value_type value;
+  template <typename Stream>
+  bool decode(Stream& stream, alphabet_type& symbol) const {
+    typename encoded_type::size_type bits = 8 * sizeof(typename encoded_type::value_type);
+    typename encoded_type::value_type value;
     bits = stream.peek(bits, value);
     if (bits == 0) {
       // end of stream or error
       return false;
     }
     for (int i = 0; i < alphabet_size; ++i) {
-      if (bits < lengths_[i]) {
+      if (lengths_[i] == 0 or bits < lengths_[i]) {
         continue;
       }
-      encoded_type::value_type mask = (1ul << lengths_[i]) - 1;
+      typename encoded_type::value_type mask = (static_cast<typename encoded_type::value_type>(1) << lengths_[i]) - 1;
       if ((value & mask) == (encoding_[i] & mask)) {
         symbol = i;
         stream.skip(lengths_[i]);
@@ -330,13 +684,177 @@ public:
   }
 
 
+private:
+  // map a signed difference to an unsigned value: 0, -1, 1, -2, 2, ... to 0, 1, 2, 3, 4, ...
+  static uint64_t zigzag(int value) { return value < 0 ? -2 * static_cast<int64_t>(value) - 1 : 2 * static_cast<uint64_t>(value); }
+  static int unzigzag(uint64_t value) { return value & 1 ? -static_cast<int>((value + 1) / 2) : static_cast<int>(value / 2); }
+
+  // serialise the canonical Huffman coding with the compact header
+  template <typename Stream>
+  void serialise_compact(Stream& stream) const {
+    stream.write(64, compact_marker);
+    stream.write(16, alphabet_size % 65536);
+    detail::write_size(stream, encoded_size_);
+    detail::write_size(stream, original_size_);
+
+    // describe the present symbols with a bitmap, or with the list of runs if it is smaller
+    uint64_t runs = 0;
+    for (int i = 0; i < alphabet_size; ++i) {
+      if (lengths_[i] > 0 and (i == 0 or lengths_[i - 1] == 0)) {
+        ++runs;
+      }
+    }
+    bool use_runs = (alphabet_bits + 1) + runs * 2 * alphabet_bits < alphabet_size;
+    stream.write(1, use_runs);
+    if (use_runs) {
+      stream.write(alphabet_bits + 1, runs);
+      int end = 0;
+      for (int i = 0; i < alphabet_size;) {
+        if (lengths_[i] == 0) {
+          ++i;
+          continue;
+        }
+        int begin = i;
+        while (i < alphabet_size and lengths_[i] > 0) {
+          ++i;
+        }
+        stream.write(alphabet_bits, begin - end);
+        stream.write(alphabet_bits, i - begin - 1);
+        end = i;
+      }
+    } else {
+      for (int i = 0; i < alphabet_size; ++i) {
+        stream.write(1, lengths_[i] > 0);
+      }
+    }
+
+    // write the lengths of the present symbols, delta coded if it is smaller
+    uint64_t fixed_bits = 0, delta_bits = 0;
+    int previous = -1;
+    for (int i = 0; i < alphabet_size; ++i) {
+      if (lengths_[i] > 0) {
+        fixed_bits += 6;
+        delta_bits += previous < 0 ? 6 : 2 * detail::significant_bits(zigzag(lengths_[i] - previous) + 1) - 1;
+        previous = lengths_[i];
+      }
+    }
+    bool use_delta = delta_bits < fixed_bits;
+    stream.write(1, use_delta);
+    previous = -1;
+    for (int i = 0; i < alphabet_size; ++i) {
+      if (lengths_[i] > 0) {
+        if (use_delta and previous >= 0) {
+          detail::write_exp_golomb(stream, zigzag(lengths_[i] - previous));
+        } else {
+          stream.write(6, lengths_[i] - 1);
+        }
+        previous = lengths_[i];
+      }
+    }
+  }
+
+  // deserialise the canonical Huffman coding from a compact header, after the marker; return false if the header is truncated or
+  // corrupted
+  template <typename Stream>
+  bool deserialise_compact(Stream& stream) {
+    compact_ = true;
+    detail::checked_reader<Stream> in{stream};
+
+    // check that the alphabet size matches the Huffman coding
+    uint16_t read_alphabet_size = 0;
+    in.read(16, read_alphabet_size);
+    if (alphabet_size % 65536 != read_alphabet_size) {
+      return false;
+    }
+
+    encoded_size_ = detail::read_size(in);
+    original_size_ = detail::read_size(in);
+
+    // read the present symbols, marking them with a temporary length
+    std::fill(lengths_, lengths_ + alphabet_size, 0);
+    bool use_runs = false;
+    in.read(1, use_runs);
+    if (use_runs) {
+      uint64_t runs = 0;
+      in.read(alphabet_bits + 1, runs);
+      uint64_t end = 0;
+      for (uint64_t run = 0; run < runs; ++run) {
+        uint64_t distance = 0, length = 0;
+        in.read(alphabet_bits, distance);
+        in.read(alphabet_bits, length);
+        uint64_t begin = end + distance;
+        end = std::min<uint64_t>(begin + length + 1, alphabet_size);
+        for (uint64_t i = begin; i < end; ++i) {
+          lengths_[i] = 1;
+        }
+      }
+    } else {
+      for (int i = 0; i < alphabet_size; ++i) {
+        bool present = false;
+        in.read(1, present);
+        lengths_[i] = present;
+      }
+    }
+
+    // read the lengths of the present symbols
+    bool use_delta = false;
+    in.read(1, use_delta);
+    int previous = -1;
+    for (int i = 0; i < alphabet_size; ++i) {
+      if (lengths_[i] > 0) {
+        int length;
+        if (use_delta and previous >= 0) {
+          length = previous + unzigzag(detail::read_exp_golomb(in));
+        } else {
+          typename encoded_type::size_type bits_minus_one = 0;
+          in.read(6, bits_minus_one);
+          length = bits_minus_one + 1;
+        }
+        // a corrupted header could give invalid lengths
+        lengths_[i] = std::clamp(length, 1, max_code_length);
+        previous = lengths_[i];
+      }
+    }
+
+    if (not in.complete) {
+      return false;
+    }
+
+    // build the canonical Huffman coding from the legths of the encoding of each symbol
+    build_canonical_coding();
+    return true;
+  }
+
+  // serialise() writes the compact header
+  bool compact_ = false;
+
 public:
+  // size of the full header (in bits)
+  static constexpr uint64_t full_header_size = 64                  // 64 bit:            encode the encoded message size, including the header itself, in bits
+                                             + 64                  // 64 bit:            encode the original message size, in symbols
+                                             + 16                  // 16 bit:            encode the number of symbols in the alphabet
+                                                                   //                    [NB: could be replaced by alphabet_bits - 1]
+                                             + 6 * alphabet_size;  //  6 bit per symbol: encode the size of each symbol's coding - 1
+
+  // The compact header describes only the symbols that are present in the input:
+  //   64 bit:            `compact_marker`, that cannot be the message size of a full header
+  //   16 bit:            the number of symbols in the alphabet, as in the full header
+  //   6 + N bit:         the size of the encoded message (without the header) in bits, as the number of significant bits N followed
+  //                      by the N bits of the value
+  //   6 + N bit:         the original message size, in symbols, in the same format
+  //   1 bit:             0 if the present symbols are described by a bitmap, 1 for a list of runs
+  //   bitmap:            1 bit per symbol, set if the symbol is present
+  //   runs:              alphabet_bits + 1 bit for the number of runs, and for each run, alphabet_bits bit for the distance from
+  //                      the end of the previous run and alphabet_bits bit for the length of the run - 1
+  //   1 bit:             0 if the lengths are stored as in the full header, 1 if they are delta coded
+  //   6 bit per symbol:  the size of each present symbol's coding - 1
+  //   delta coded:       6 bit for the size of the first present symbol's coding - 1, and for the next ones the difference from
+  //                      the previous size, zigzag mapped to an unsigned value and written as an Exp-Golomb code
+  // The representations of the symbols and of the lengths are chosen to minimise the size of the header.
+  static constexpr uint64_t compact_marker = 1;
+
   // size of the header (in bits)
-  uint64_t header_size_ = 64                  // 64 bit:            encode the encoded message size, including the header itself, in bits
-                        + 64                  // 64 bit:            encode the original message size, in symbols
-                        + 16                  // 16 bit:            encode the number of symbols in the alphabet
-                                              //                    [NB: could be replaced by alphabet_bits - 1]
-                        + 6 * alphabet_size;  //  6 bit per symbol: encode the size of each symbol's coding - 1
+  uint64_t header_size_ = full_header_size;
 
   // size of the decoded (original) message (in symbols), and of the encodoed version (in bits)
   uint64_t original_size_ = 0;
@@ -346,8 +864,11 @@ public:
   weight_type weights_[alphabet_size];
 
   // Huffman encoding of each symbol
-  encoded_type::size_type lengths_[alphabet_size];
-  encoded_type::value_type encoding_[alphabet_size];
+  typename encoded_type::size_type lengths_[alphabet_size];
+  typename encoded_type::value_type encoding_[alphabet_size];
 };
 
+// coding of 8-bit symbols
+using huffman_encoding = basic_huffman_encoding<uint8_t>;
+
 #endif  // huffman_h
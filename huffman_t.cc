@@ -1,8 +1,16 @@
+#include <algorithm>
+#include <cassert>
 #include <iomanip>
 #include <iostream>
+#include <queue>
+#include <random>
 #include <string>
+#include <utility>
+#include <vector>
 
+#include "bitreader.h"
 #include "bitstream.h"
+#include "bitwriter.h"
 #include "huffman.h"
 
 template <typename T>
@@ -50,7 +58,8 @@ int main(int argc, const char* argv[]) {
 
   {
     huffman_encoding huffman;
-    huffman.deserialise(stream);
+    bool deserialised = huffman.deserialise(stream);
+    assert(deserialised);
     size_t header_size = stream.tellg();
     std::cout << "Huffman header (" << header_size << " bits)" << std::endl;
 
@@ -74,4 +83,194 @@ int main(int argc, const char* argv[]) {
   }
 
   assert(message == decoded);
+
+  {
+    // Fibonacci-distributed weights lead to the longest possible encodings
+    std::vector<uint8_t> data;
+    uint64_t a = 1, b = 1;
+    for (int symbol = 0; symbol < 30; ++symbol) {
+      data.insert(data.end(), a, static_cast<uint8_t>(symbol));
+      b = a + b;
+      a = b - a;
+    }
+
+    huffman_encoding unlimited(data.data(), data.size());
+    std::cout << std::endl;
+    std::cout << "unlimited Huffman coding: longest code " << (int) *std::max_element(unlimited.lengths_, unlimited.lengths_ + 256)
+              << " bits, encoded size " << unlimited.encoded_size_ << " bits" << std::endl;
+
+    for (int max_length : {8, 11, 15, 24}) {
+      huffman_encoding limited(data.data(), data.size(), max_length);
+      int longest = *std::max_element(limited.lengths_, limited.lengths_ + 256);
+      std::cout << "limited to " << max_length << " bits:     longest code " << longest << " bits, encoded size " << limited.encoded_size_
+                << " bits" << std::endl;
+      assert(longest <= max_length);
+      assert(limited.encoded_size_ >= unlimited.encoded_size_);
+
+      // check that the Kraft sum is exactly one, so that the coding is complete, and that only the symbols in the input are
+      // given an encoding
+      uint64_t kraft = 0;
+      for (int i = 0; i < 256; ++i) {
+        assert((limited.lengths_[i] > 0) == (limited.weights_[i] > 0));
+        if (limited.lengths_[i] > 0) {
+          kraft += 1ul << (max_length - limited.lengths_[i]);
+        }
+      }
+      assert(kraft == 1ul << max_length);
+    }
+  }
+
+  {
+    // build a coding from a sample of the input: every symbol stays encodable, even if it is not in the sample
+    std::vector<uint8_t> data(100 * huffman_encoding::sample_block_size);
+    for (size_t i = 0; i < data.size(); ++i) {
+      data[i] = (i % 7 == 0) ? 'a' : (i % 3 == 0) ? 'b' : 'c';
+    }
+    data[huffman_encoding::sample_block_size + 1] = 'z';
+
+    huffman_encoding full(data.data(), data.size(), 15);
+    huffman_encoding sampled;
+    sampled.scan_sample(data.data(), data.size(), 10);
+    sampled.build_from_weights(15);
+    std::cout << std::endl;
+    std::cout << "sampled Huffman coding: 'a' " << (int) sampled.lengths_['a'] << " bits, 'z' " << (int) sampled.lengths_['z']
+              << " bits" << std::endl;
+    assert(sampled.original_size_ == data.size());
+    for (int i = 0; i < 256; ++i) {
+      assert(sampled.weights_[i] > 0);
+      assert(sampled.lengths_[i] > 0 and sampled.lengths_[i] <= 15);
+    }
+    // the frequent symbols get the same encodings as with the full scan
+    for (int symbol : {'a', 'b', 'c'}) {
+      assert(sampled.lengths_[symbol] == full.lengths_[symbol]);
+    }
+
+    // the weights of a sample of a 64 GiB input, one block out of 16, are scaled up without overflowing
+    uint64_t size = uint64_t(1) << 36;
+    uint64_t in_sample = size / 16;
+    uint64_t weight = huffman_encoding::scale_weight(in_sample, in_sample, size);
+    assert(weight == size);
+    weight = huffman_encoding::scale_weight(in_sample / 4 * 3, in_sample, size);
+    assert(weight == size / 4 * 3);
+    weight = huffman_encoding::scale_weight(1, in_sample, size);
+    assert(weight == 16);
+    weight = huffman_encoding::scale_weight(7, 0, size);
+    assert(weight == 0);
+  }
+
+  {
+    // the in-place construction is optimal: the encoded size is the sum of the weights of all the internal nodes of a Huffman
+    // tree, computed here with a priority queue; the symbols not in the input are not given an encoding
+    std::mt19937 random(42);
+    for (int symbols : {1, 2, 3, 17, 200, 256}) {
+      std::vector<uint8_t> data;
+      for (int symbol = 0; symbol < symbols; ++symbol) {
+        data.insert(data.end(), 1 + random() % 1000, static_cast<uint8_t>(symbol * 256 / symbols));
+      }
+      huffman_encoding encoding(data.data(), data.size());
+
+      std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> queue;
+      for (int i = 0; i < 256; ++i) {
+        if (encoding.weights_[i] > 0) {
+          queue.push(encoding.weights_[i]);
+        }
+      }
+      uint64_t expected = symbols == 1 ? data.size() : 0;
+      while (queue.size() > 1) {
+        uint64_t first = queue.top();
+        queue.pop();
+        uint64_t second = queue.top();
+        queue.pop();
+        expected += first + second;
+        queue.push(first + second);
+      }
+      std::cout << symbols << " symbols: encoded size " << encoding.encoded_size_ << " bits" << std::endl;
+      assert(encoding.encoded_size_ == expected);
+      for (int i = 0; i < 256; ++i) {
+        assert((encoding.lengths_[i] > 0) == (encoding.weights_[i] > 0));
+      }
+
+      // the unused symbols survive a round trip through the serialised coding
+      bitstream stream;
+      encoding.serialise(stream);
+      stream.seekg(0);
+      huffman_encoding deserialised;
+      bool valid = deserialised.deserialise(stream);
+      assert(valid);
+      assert(std::equal(encoding.lengths_, encoding.lengths_ + 256, deserialised.lengths_));
+      assert(std::equal(encoding.encoding_, encoding.encoding_ + 256, deserialised.encoding_));
+    }
+  }
+
+  {
+    // the compact header round-trips for different sets of present symbols: none, a single one, a few runs of symbols, scattered
+    // symbols (described by a bitmap), and the whole alphabet
+    std::vector<std::vector<uint8_t>> messages(5);
+    messages[1].assign(100, 'x');
+    messages[2].assign(message.begin(), message.end());
+    for (int i = 0; i < 2000; ++i) {
+      messages[3].push_back(static_cast<uint8_t>((i * i) % 251 * 7));
+      messages[4].push_back(static_cast<uint8_t>(i));
+    }
+    for (auto const& data : messages) {
+      huffman_encoding encoding(data.data(), data.size());
+      uint64_t full_size = encoding.header_size_;
+      encoding.use_compact_header();
+      std::cout << "message of " << data.size() << " bytes: full header of " << full_size << " bits, compact header of "
+                << encoding.header_size_ << " bits" << std::endl;
+      assert(encoding.header_size_ <= full_size);
+
+      bitstream stream;
+      encoding.serialise(stream);
+      for (uint8_t symbol : data) {
+        encoding.encode(stream, symbol);
+      }
+      assert(stream.size() == encoding.header_size_ + encoding.encoded_size_);
+      stream.seekg(0);
+      huffman_encoding deserialised;
+      bool valid = deserialised.deserialise(stream);
+      assert(valid);
+      assert(deserialised.header_size_ == encoding.header_size_);
+      assert(deserialised.encoded_size_ == encoding.encoded_size_);
+      assert(deserialised.original_size_ == data.size());
+      assert(std::equal(encoding.lengths_, encoding.lengths_ + 256, deserialised.lengths_));
+      std::vector<uint8_t> decoded(data.size());
+      for (auto& symbol : decoded) {
+        valid = deserialised.decode(stream, symbol);
+        assert(valid);
+      }
+      assert(decoded == data);
+
+      // a header that is truncated, or for a different alphabet, is rejected
+      bitwriter header;
+      encoding.serialise(header);
+      header.flush();
+      bitreader truncated(header.data(), encoding.header_size_ - 1);
+      valid = deserialised.deserialise(truncated);
+      assert(not valid);
+      std::vector<uint8_t> other(header.data(), header.data() + header.bytes());
+      other[8] ^= 0x01;
+      bitreader other_alphabet(other.data(), encoding.header_size_);
+      valid = deserialised.deserialise(other_alphabet);
+      assert(not valid);
+    }
+  }
+
+  {
+    // weights that follow the Fibonacci sequence build the deepest tree, whose unrestricted lengths are longer than the largest
+    // length supported by the encoding, and are limited to it
+    using limited_encoding = basic_huffman_encoding<uint8_t, 256, 15>;
+    std::vector<uint8_t> data;
+    uint64_t previous = 1, current = 1;
+    for (int symbol = 0; symbol < 24; ++symbol) {
+      data.insert(data.end(), current, static_cast<uint8_t>(symbol));
+      current += std::exchange(previous, current);
+    }
+    limited_encoding encoding;
+    encoding.scan_input(data.data(), data.size());
+    encoding.build_from_weights();
+    uint8_t longest = *std::max_element(encoding.lengths_, encoding.lengths_ + 256);
+    std::cout << "Fibonacci weights for 24 symbols: longest code of " << int(longest) << " bits" << std::endl;
+    assert(longest == limited_encoding::max_code_length);
+  }
 }
@@ -86,7 +86,41 @@ namespace iterative_inversion {
 
 }  // namespace iterative_inversion
 
-// use the lookup table approach by default
-using lookup_inversion::invert_bits;
+namespace swap_inversion {
+
+  namespace details {
+
+    // swap the bytes of `value`
+    constexpr uint8_t swap_bytes(uint8_t value) { return value; }
+    constexpr uint16_t swap_bytes(uint16_t value) { return __builtin_bswap16(value); }
+    constexpr uint32_t swap_bytes(uint32_t value) { return __builtin_bswap32(value); }
+    constexpr uint64_t swap_bytes(uint64_t value) { return __builtin_bswap64(value); }
+
+    // swap the adjacent groups of `bits` bits of `value`, where `mask` selects every other group
+    template <typename T>
+    constexpr T swap_groups(T value, unsigned int bits, T mask) {
+      return static_cast<T>((value >> bits) & mask) | static_cast<T>((value & mask) << bits);
+    }
+
+  }  // namespace details
+
+  // invert the `size` lowest significant bits of `value`
+  // this variant is implemented swapping the bytes with a single instruction, and then the nibbles, the pairs and the bits within
+  // each byte with masks, without any memory access
+  template <typename T>
+  constexpr T invert_bits(T value, unsigned int size = sizeof(T) * 8) {
+    assert(size <= sizeof(T) * 8);
+    constexpr T ones = static_cast<T>(~T(0));
+    value = details::swap_bytes(value);
+    value = details::swap_groups(value, 4, static_cast<T>(ones / 0x11));  // 0x0f0f...
+    value = details::swap_groups(value, 2, static_cast<T>(ones / 0x05));  // 0x3333...
+    value = details::swap_groups(value, 1, static_cast<T>(ones / 0x03));  // 0x5555...
+    return value >> (sizeof(T) * 8 - size);
+  }
+
+}  // namespace swap_inversion
+
+// use the byte swap approach by default
+using swap_inversion::invert_bits;
 
 #endif  // invert_h
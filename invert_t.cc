@@ -58,4 +58,33 @@ int main(int argc, const char* argv[]) {
     log(value, inverted, expected, 24);
     assert(inverted == expected);
   }
+
+  {
+    // the variants agree on all sizes of all widths
+    uint64_t value = 0x0123456789ABCDEF;
+    for (unsigned int size = 1; size <= 64; ++size) {
+      uint64_t swapped = swap_inversion::invert_bits(value, size);
+      uint64_t looked_up = lookup_inversion::invert_bits(value, size);
+      uint64_t iterated = iterative_inversion::invert_bits(value, size);
+      assert(swapped == looked_up and swapped == iterated);
+      if (size <= 32) {
+        uint32_t word = static_cast<uint32_t>(value);
+        uint32_t swapped = swap_inversion::invert_bits(word, size);
+        uint32_t looked_up = lookup_inversion::invert_bits(word, size);
+        assert(swapped == looked_up);
+      }
+      if (size <= 16) {
+        uint16_t word = static_cast<uint16_t>(value);
+        uint16_t swapped = swap_inversion::invert_bits(word, size);
+        uint16_t looked_up = lookup_inversion::invert_bits(word, size);
+        assert(swapped == looked_up);
+      }
+      if (size <= 8) {
+        uint8_t byte = static_cast<uint8_t>(value);
+        uint8_t swapped = swap_inversion::invert_bits(byte, size);
+        uint8_t looked_up = lookup_inversion::invert_bits(byte, size);
+        assert(swapped == looked_up);
+      }
+    }
+  }
 }
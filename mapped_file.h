@@ -0,0 +1,139 @@
+#ifndef mapped_file_h
+#define mapped_file_h
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* memory mapping of a regular file, for reading or for writing
+ *
+ * Only regular files can be mapped: for anything else (pipes, terminals, character devices, ...) the mapping is not valid, and
+ * the caller should fall back to the usual stream-based I/O. The mappings are advised for sequential access.
+ */
+
+class mapped_file {
+public:
+  // an invalid mapping
+  mapped_file() = default;
+
+  // map the regular file `name` for reading
+  static mapped_file open_read(const char* name) {
+    mapped_file file;
+    int fd = ::open(name, O_RDONLY);
+    if (fd < 0) {
+      return file;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0 or not S_ISREG(info.st_mode)) {
+      ::close(fd);
+      return file;
+    }
+    file.fd_ = fd;
+    file.size_ = info.st_size;
+    if (not file.map(PROT_READ)) {
+      return mapped_file();
+    }
+    return file;
+  }
+
+  // create or truncate the regular file `name`, resize it to `size` bytes, and map it for writing
+  static mapped_file open_write(const char* name, size_t size) {
+    mapped_file file;
+    // do not truncate or create anything that is not a regular file
+    struct stat info;
+    if (::stat(name, &info) == 0 and not S_ISREG(info.st_mode)) {
+      return file;
+    }
+    int fd = ::open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      return file;
+    }
+    if (::ftruncate(fd, size) != 0) {
+      ::close(fd);
+      return file;
+    }
+    file.fd_ = fd;
+    file.size_ = size;
+    file.writable_ = true;
+    if (not file.map(PROT_READ | PROT_WRITE)) {
+      return mapped_file();
+    }
+    return file;
+  }
+
+  mapped_file(mapped_file const&) = delete;
+  mapped_file& operator=(mapped_file const&) = delete;
+
+  mapped_file(mapped_file&& other) { swap(other); }
+
+  mapped_file& operator=(mapped_file&& other) {
+    swap(other);
+    return *this;
+  }
+
+  // unmap and close the file; a file mapped for writing is truncated to its final size
+  ~mapped_file() {
+    if (data_) {
+      ::munmap(data_, mapped_);
+    }
+    if (fd_ >= 0) {
+      if (writable_ and size_ < mapped_) {
+        [[maybe_unused]] int status = ::ftruncate(fd_, size_);
+      }
+      ::close(fd_);
+    }
+  }
+
+  // true if the file has been mapped successfuly
+  bool valid() const { return fd_ >= 0; }
+
+  // access the mapped memory; the pointer is null for an empty file
+  uint8_t* data() { return static_cast<uint8_t*>(data_); }
+  uint8_t const* data() const { return static_cast<uint8_t const*>(data_); }
+
+  // size of the file, in bytes
+  size_t size() const { return size_; }
+
+  // shrink a file mapped for writing to `size` bytes, when it is closed
+  void truncate(size_t size) {
+    if (size < size_) {
+      size_ = size;
+    }
+  }
+
+private:
+  // map the whole file, and advise the kernel that it will be accessed sequentially
+  bool map(int protection) {
+    mapped_ = size_;
+    if (size_ > 0) {
+      void* data = ::mmap(nullptr, size_, protection, MAP_SHARED, fd_, 0);
+      if (data == MAP_FAILED) {
+        return false;
+      }
+      data_ = data;
+      ::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    return true;
+  }
+
+  void swap(mapped_file& other) {
+    std::swap(fd_, other.fd_);
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(mapped_, other.mapped_);
+    std::swap(writable_, other.writable_);
+  }
+
+  int fd_ = -1;            // file descriptor
+  void* data_ = nullptr;   // mapped memory
+  size_t size_ = 0;        // size of the file
+  size_t mapped_ = 0;      // size of the mapped memory
+  bool writable_ = false;  // the file is mapped for writing
+};
+
+#endif  // mapped_file_h
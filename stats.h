@@ -0,0 +1,276 @@
+#ifndef stats_h
+#define stats_h
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+#include <fmt/printf.h>
+
+/* timing and counters of the phases of the encoding and decoding, reported by the --stats option of the command line tools
+ *
+ * The phases are timed where they are implemented, so that every path through the library is covered: the reading of the input,
+ * scan_input(), the build of the tree and of the canonical coding, the build of the decoding tables, the encoding or decoding of
+ * the symbols, and the writing of the output. Each timer records the wall time and the CPU time of its own thread, and the times
+ * of a phase are summed over all the threads that run it, so they can add up to more than the elapsed time with -j.
+ *
+ * The counters record the bytes in and out, the code lengths weighted by the number of symbols of each Huffman coding built, with
+ * the entropy of these symbols, and how many symbols the decoding tables have decoded, among which the ones that needed the slow
+ * path of the encodings longer than the primary table; the fast path is not counted, so that the inner loop does not change.
+ *
+ * Nothing is recorded until enable() is called, at the cost of a relaxed load and a branch in each instrumented function. With
+ * WITHER_STATS defined as 0, the instrumentation compiles to nothing, and the --stats option only reports that it is unavailable.
+ */
+
+#ifndef WITHER_STATS
+#define WITHER_STATS 1
+#endif
+
+namespace stats {
+
+  enum class phase { read, scan, tree, canonical, tables, coding, write };
+  constexpr int phases = 7;
+
+  enum class counter { bytes_in, bytes_out, codings, coded_symbols, coded_bits, table_symbols, slow_symbols };
+  constexpr int counters = 7;
+
+  // the longest code length recorded in the distribution
+  constexpr int max_code_length = 64;
+
+  // name of the phase `value`
+  inline const char* name(phase value) {
+    switch (value) {
+      case phase::read: return "read";
+      case phase::scan: return "scan_input";
+      case phase::tree: return "tree";
+      case phase::canonical: return "canonical";
+      case phase::tables: return "tables";
+      case phase::coding: return "coding";
+      default: return "write";
+    }
+  }
+
+#if WITHER_STATS
+
+  namespace detail {
+
+    // the entropy is accumulated in fixed point, in units of 2^-16 bit
+    constexpr double entropy_unit = 65536.0;
+
+    struct state {
+      std::atomic<bool> enabled{false};
+      std::atomic<uint64_t> wall[phases] = {};
+      std::atomic<uint64_t> cpu[phases] = {};
+      std::atomic<uint64_t> values[counters] = {};
+      std::atomic<uint64_t> entropy{0};
+      std::atomic<uint64_t> lengths[max_code_length + 1] = {};
+      uint64_t start_wall = 0;
+      uint64_t start_cpu = 0;
+    };
+    inline state global;
+
+    inline uint64_t nanoseconds(timespec const& time) { return uint64_t(time.tv_sec) * 1000000000 + time.tv_nsec; }
+
+    inline uint64_t wall_time() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline uint64_t thread_time() {
+      timespec time;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+      return nanoseconds(time);
+    }
+
+    inline uint64_t process_time() {
+      timespec time;
+      clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+      return nanoseconds(time);
+    }
+
+  }  // namespace detail
+
+  constexpr bool available = true;
+
+  // true once the recording has been enabled
+  inline bool enabled() { return detail::global.enabled.load(std::memory_order_relaxed); }
+
+  // start recording, and the elapsed time reported by report()
+  inline void enable() {
+    detail::global.start_wall = detail::wall_time();
+    detail::global.start_cpu = detail::process_time();
+    detail::global.enabled.store(true, std::memory_order_relaxed);
+  }
+
+  // add `value` to the counter `which`
+  inline void count(counter which, uint64_t value) {
+    if (enabled()) {
+      detail::global.values[static_cast<int>(which)].fetch_add(value, std::memory_order_relaxed);
+    }
+  }
+
+  // value of the counter `which`
+  inline uint64_t value(counter which) { return detail::global.values[static_cast<int>(which)].load(std::memory_order_relaxed); }
+
+  // record the code lengths of a Huffman coding of `alphabet_size` symbols, weighted by the number of symbols they code
+  template <typename Weight, typename Length>
+  void record_coding(Weight const* weights, Length const* lengths, int alphabet_size) {
+    if (not enabled()) {
+      return;
+    }
+    uint64_t total = 0, bits = 0;
+    for (int i = 0; i < alphabet_size; ++i) {
+      total += weights[i];
+    }
+    double entropy = 0;
+    for (int i = 0; i < alphabet_size; ++i) {
+      if (weights[i] > 0) {
+        bits += uint64_t(weights[i]) * lengths[i];
+        entropy += weights[i] * std::log2(double(total) / weights[i]);
+        detail::global.lengths[std::min<int>(lengths[i], max_code_length)].fetch_add(weights[i], std::memory_order_relaxed);
+      }
+    }
+    count(counter::codings, 1);
+    count(counter::coded_symbols, total);
+    count(counter::coded_bits, bits);
+    detail::global.entropy.fetch_add(uint64_t(entropy * detail::entropy_unit), std::memory_order_relaxed);
+  }
+
+  // time the phase `which` on this thread, from the construction to the destruction of the timer
+  class timer {
+  public:
+    explicit timer(phase which) : phase_(static_cast<int>(which)), active_(enabled()) {
+      if (active_) {
+        wall_ = detail::wall_time();
+        cpu_ = detail::thread_time();
+      }
+    }
+
+    ~timer() {
+      if (active_) {
+        detail::global.wall[phase_].fetch_add(detail::wall_time() - wall_, std::memory_order_relaxed);
+        detail::global.cpu[phase_].fetch_add(detail::thread_time() - cpu_, std::memory_order_relaxed);
+      }
+    }
+
+    timer(timer const&) = delete;
+    timer& operator=(timer const&) = delete;
+
+  private:
+    int phase_;
+    bool active_;
+    uint64_t wall_ = 0;
+    uint64_t cpu_ = 0;
+  };
+
+  // write the statistics recorded since enable() to `out`, as text or as a JSON object
+  inline void report(FILE* out, bool json) {
+    auto const& state = detail::global;
+    double elapsed = (detail::wall_time() - state.start_wall) * 1e-6;
+    double cpu = (detail::process_time() - state.start_cpu) * 1e-6;
+    uint64_t bytes_in = value(counter::bytes_in), bytes_out = value(counter::bytes_out);
+    uint64_t symbols = value(counter::coded_symbols), table_symbols = value(counter::table_symbols);
+    uint64_t slow_symbols = std::min(value(counter::slow_symbols), table_symbols);
+    double entropy = symbols ? state.entropy.load() / detail::entropy_unit / symbols : 0;
+    double code_bits = symbols ? double(value(counter::coded_bits)) / symbols : 0;
+    double fast_rate = table_symbols ? double(table_symbols - slow_symbols) / table_symbols : 0;
+
+    if (json) {
+      fmt::fprintf(out, "{\n  \"phases\": {");
+      for (int i = 0; i < phases; ++i) {
+        fmt::fprintf(out, "%s\n    \"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", i ? "," : "", name(phase(i)), state.wall[i] * 1e-6, state.cpu[i] * 1e-6);
+      }
+      fmt::fprintf(out, "\n  },\n  \"elapsed_ms\": %.3f,\n  \"cpu_ms\": %.3f,\n", elapsed, cpu);
+      fmt::fprintf(out, "  \"bytes_in\": %d,\n  \"bytes_out\": %d,\n", bytes_in, bytes_out);
+      fmt::fprintf(out, "  \"codings\": %d,\n  \"coded_symbols\": %d,\n", value(counter::codings), symbols);
+      fmt::fprintf(out, "  \"entropy_bits_per_symbol\": %.4f,\n  \"code_bits_per_symbol\": %.4f,\n", entropy, code_bits);
+      fmt::fprintf(out, "  \"code_lengths\": {");
+      const char* separator = "";
+      for (int length = 0; length <= max_code_length; ++length) {
+        if (uint64_t count = state.lengths[length].load()) {
+          fmt::fprintf(out, "%s\"%d\": %d", separator, length, count);
+          separator = ", ";
+        }
+      }
+      fmt::fprintf(out, "},\n  \"table_symbols\": %d,\n  \"slow_path_symbols\": %d,\n  \"fast_path_rate\": %.6f\n}\n", table_symbols,
+                   slow_symbols, fast_rate);
+      return;
+    }
+
+    fmt::fprintf(out, "%-12s %12s %12s\n", "phase", "wall (ms)", "cpu (ms)");
+    for (int i = 0; i < phases; ++i) {
+      fmt::fprintf(out, "%-12s %12.3f %12.3f\n", name(phase(i)), state.wall[i] * 1e-6, state.cpu[i] * 1e-6);
+    }
+    fmt::fprintf(out, "%-12s %12.3f %12.3f\n", "elapsed", elapsed, cpu);
+    fmt::fprintf(out, "bytes in:    %d\nbytes out:   %d", bytes_in, bytes_out);
+    if (bytes_in > 0) {
+      fmt::fprintf(out, " (%.2f%%)", 100.0 * bytes_out / bytes_in);
+    }
+    fmt::fprintf(out, "\n");
+    if (symbols > 0) {
+      fmt::fprintf(out, "codings:     %d, coding %d symbols\n", value(counter::codings), symbols);
+      fmt::fprintf(out, "bits/symbol: %.4f with the Huffman codes, %.4f entropy\n", code_bits, entropy);
+      fmt::fprintf(out, "code lengths:");
+      for (int length = 0; length <= max_code_length; ++length) {
+        if (uint64_t count = state.lengths[length].load()) {
+          fmt::fprintf(out, " %d:%.2f%%", length, 100.0 * count / symbols);
+        }
+      }
+      fmt::fprintf(out, "\n");
+    }
+    if (table_symbols > 0) {
+      fmt::fprintf(out, "tables:      %d symbols decoded, %.4f%% fast path, %d slow path\n", table_symbols, 100 * fast_rate, slow_symbols);
+    }
+  }
+
+#else
+
+  constexpr bool available = false;
+
+  constexpr bool enabled() { return false; }
+  inline void enable() {}
+  inline void count(counter, uint64_t) {}
+  inline uint64_t value(counter) { return 0; }
+
+  template <typename Weight, typename Length>
+  void record_coding(Weight const*, Length const*, int) {}
+
+  class timer {
+  public:
+    explicit timer(phase) {}
+  };
+
+  inline void report(FILE* out, bool) { fmt::fprintf(out, "statistics are not available: built with WITHER_STATS=0\n"); }
+
+#endif
+
+  // enable the recording if `active` is true, and write the statistics to the standard error at the end of the scope, as text or
+  // as a JSON object
+  class scoped_report {
+  public:
+    scoped_report(bool active, bool json) : active_(active), json_(json) {
+      if (active_) {
+        enable();
+      }
+    }
+
+    ~scoped_report() {
+      if (active_) {
+        report(stderr, json_);
+      }
+    }
+
+    scoped_report(scoped_report const&) = delete;
+    scoped_report& operator=(scoped_report const&) = delete;
+
+  private:
+    bool active_;
+    bool json_;
+  };
+
+}  // namespace stats
+
+#endif  // stats_h
@@ -0,0 +1,278 @@
+#ifndef streaming_h
+#define streaming_h
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "decoder.h"
+#include "dictionary.h"
+#include "huffman.h"
+
+/* incremental encoding and decoding of a stream of symbols, for producers that cannot wait for the whole input
+ *
+ * The other formats start with the sizes of the whole message; a stream instead starts with its coding, and the symbols follow in
+ * segments, each emitted by a flush of the encoder as soon as its symbols have been pushed, and each decoded as soon as its bytes
+ * arrive. The coding is either a pre-trained one, referenced by its identifier (see dictionary.h), or built from the symbols of
+ * the first flush, with an encoding for every symbol of the alphabet so that it can encode all the next ones:
+ *
+ *   stream header:     8 bytes   magic number: "wither" 0x04 0xff
+ *                      1 byte    0 if the coding follows, 1 for a pre-trained coding
+ *                      4 bytes   size N of the coding, in bytes, and
+ *                      N bytes   the serialised canonical Huffman coding, with no encoded message
+ *                   or 8 bytes   identifier of the pre-trained coding
+ *   segment:                     size of the number of symbols K, in bits (6 bits), and K itself
+ *                                the K encoded symbols, padded to a whole number of bytes
+ *   ...
+ *   end of stream:     a segment of no symbols
+ *
+ * Each segment only costs the few bits of its number of symbols and its padding, so that a flush can be as small as a record.
+ */
+
+namespace streaming {
+
+  constexpr uint8_t magic[8] = {'w', 'i', 't', 'h', 'e', 'r', 0x04, 0xff};
+
+  // return true if the `size` bytes of `data` start with the magic number of a stream
+  inline bool is_stream(uint8_t const* data, size_t size) { return size >= sizeof(magic) and std::memcmp(data, magic, sizeof(magic)) == 0; }
+
+  class encoder {
+  public:
+    using alphabet_type = huffman_encoding::alphabet_type;
+
+    // encode with a coding built from the symbols of the first flush, with encodings of at most `max_length` bits
+    explicit encoder(int max_length = huffman_encoding::alphabet_bits + 7) : max_length_(max_length) {}
+
+    // encode with the pre-trained coding `dictionary`, that must outlive the encoder
+    explicit encoder(dictionary::cache::entry const& dictionary) : dictionary_(&dictionary) {}
+
+    // append `size` symbols from `data` to the next segment
+    void push(alphabet_type const* data, size_t size) { pending_.insert(pending_.end(), data, data + size); }
+
+    // number of symbols pushed since the last flush
+    size_t pending() const { return pending_.size(); }
+
+    // append the stream header if it has not been written yet, and the symbols pushed since the last flush as a segment, to `out`,
+    // that must be at a byte boundary; `out` is then flushed, at a byte boundary, so that all its bytes can be sent
+    void flush(bitwriter& out) {
+      assert(out.size() % 8 == 0);
+      if (pending_.empty()) {
+        // nothing to emit, and the coding may not be known yet
+        return;
+      }
+      write_header(out);
+      write_segment(out, pending_.data(), pending_.size());
+      pending_.clear();
+      out.flush();
+    }
+
+    // flush the remaining symbols, and append the end of stream marker to `out`; nothing can be pushed after that
+    void finish(bitwriter& out) {
+      assert(out.size() % 8 == 0);
+      write_header(out);
+      if (not pending_.empty()) {
+        write_segment(out, pending_.data(), pending_.size());
+        pending_.clear();
+      }
+      write_segment(out, nullptr, 0);
+      out.flush();
+    }
+
+  private:
+    void write_header(bitwriter& out) {
+      if (header_written_) {
+        return;
+      }
+      header_written_ = true;
+      for (uint8_t byte : magic) {
+        out.write(8, byte);
+      }
+      out.write(8, dictionary_ != nullptr);
+      if (dictionary_) {
+        out.write(64, dictionary_->id);
+        return;
+      }
+      // the coding is built from the first segment, giving every other symbol an encoding as well
+      built_ = dictionary::train(pending_.data(), pending_.size(), max_length_);
+      out.write(32, (built_.header_size_ + 7) / 8);
+      built_.serialise(out);
+      align(out);
+    }
+
+    void write_segment(bitwriter& out, alphabet_type const* data, size_t size) {
+      detail::write_size(out, size);
+      (dictionary_ ? dictionary_->encoding : built_).encode(data, size, out);
+      align(out);
+    }
+
+    static void align(bitwriter& out) { out.write((8 - out.size() % 8) % 8, 0); }
+
+    int max_length_ = huffman_encoding::alphabet_bits + 7;
+    dictionary::cache::entry const* dictionary_ = nullptr;  // pre-trained coding, if any
+    huffman_encoding built_;                                // coding built from the first segment otherwise
+    bool header_written_ = false;
+    std::vector<alphabet_type> pending_;  // symbols pushed since the last flush
+  };
+
+  class decoder {
+  public:
+    using alphabet_type = huffman_encoding::alphabet_type;
+
+    // decode the streams with the pre-trained codings of `dictionaries`, that must outlive the decoder, and the codings they carry
+    // with tables of `table_bits` bits of type `type`
+    explicit decoder(dictionary::cache const* dictionaries = nullptr, int table_bits = huffman_decoder::default_table_bits,
+                     huffman_decoder::table_type type = huffman_decoder::table_type::multi_symbol)
+        : dictionaries_(dictionaries), decoder_(table_bits, type) {}
+
+    // append the `size` bytes of `data` to the stream, and append the symbols that are complete so far to `out`; return the number
+    // of symbols appended, and 0 after an error or the end of the stream
+    size_t feed(uint8_t const* data, size_t size, std::vector<alphabet_type>& out) {
+      if (state_ == state::error or state_ == state::finished) {
+        if (size > 0) {
+          // nothing may follow the end of the stream
+          state_ = state::error;
+        }
+        return 0;
+      }
+      size_t before = out.size();
+      pending_.insert(pending_.end(), data, data + size);
+      bitreader in(pending_.data(), pending_.size() * 8);
+      in.seekg(position_);
+      while (step(in, out)) {
+      }
+      if (state_ == state::finished and in.tellg() < in.size()) {
+        // nothing may follow the end of the stream
+        state_ = state::error;
+      }
+      // drop the whole bytes that have been consumed
+      position_ = in.tellg();
+      pending_.erase(pending_.begin(), pending_.begin() + position_ / 8);
+      position_ %= 8;
+      return out.size() - before;
+    }
+
+    // true once the end of stream marker has been decoded
+    bool finished() const { return state_ == state::finished; }
+
+    // true if the stream is corrupted, references an unknown dictionary, or continues after its end
+    bool error() const { return state_ == state::error; }
+
+  private:
+    enum class state { header, segment, symbols, finished, error };
+
+    // decode the next part of the stream from `in`, into `out`; return false if more bytes are needed, or if the decoding is over
+    bool step(bitreader& in, std::vector<alphabet_type>& out) {
+      uint64_t available = in.size() - in.tellg();
+      switch (state_) {
+        case state::header: return read_header(in);
+        case state::segment: {
+          // the number of symbols, that is also the end of stream marker when it is 0
+          uint64_t bits = 0, count = 0;
+          if (available < 6) {
+            return false;
+          }
+          in.peek(6, bits);
+          if (available < 6 + bits) {
+            return false;
+          }
+          in.skip(6);
+          in.read(bits, count);
+          remaining_ = count;
+          state_ = count > 0 ? state::symbols : state::finished;
+          if (count == 0) {
+            align(in);
+          }
+          return count > 0;
+        }
+        case state::symbols: {
+          // each encoding has at least one bit, so that the output is not resized past the symbols that can be decoded
+          size_t wanted = std::min<uint64_t>(remaining_, available);
+          size_t first = out.size();
+          out.resize(first + wanted);
+          size_t decoded = tables_->decode(in, out.data() + first, wanted);
+          out.resize(first + decoded);
+          remaining_ -= decoded;
+          if (remaining_ > 0) {
+            // an encoding is cut by the end of the bytes received so far, unless it would have fitted
+            if (decoded < wanted and in.size() - in.tellg() >= uint64_t(tables_->max_length())) {
+              state_ = state::error;
+            }
+            return false;
+          }
+          align(in);
+          state_ = state::segment;
+          return true;
+        }
+        default: return false;
+      }
+    }
+
+    // read the stream header from `in`, once it is complete; return false if more bytes are needed, or if it is not valid
+    bool read_header(bitreader& in) {
+      uint64_t available = (in.size() - in.tellg()) / 8;
+      if (available < sizeof(magic) + 1) {
+        return false;
+      }
+      uint8_t const* data = pending_.data() + in.tellg() / 8;
+      if (not is_stream(data, available) or data[sizeof(magic)] > 1) {
+        state_ = state::error;
+        return false;
+      }
+      if (data[sizeof(magic)] == 1) {
+        // pre-trained coding
+        uint64_t id;
+        if (available < sizeof(magic) + 1 + sizeof(id)) {
+          return false;
+        }
+        std::memcpy(&id, data + sizeof(magic) + 1, sizeof(id));
+        dictionary::cache::entry const* entry = dictionaries_ ? dictionaries_->find(id) : nullptr;
+        if (not entry) {
+          state_ = state::error;
+          return false;
+        }
+        tables_ = &entry->decoder;
+        in.skip((sizeof(magic) + 1 + sizeof(id)) * 8);
+      } else {
+        // embedded coding, read once all its bytes have been received
+        uint32_t coding_bytes;
+        if (available < sizeof(magic) + 1 + sizeof(coding_bytes)) {
+          return false;
+        }
+        std::memcpy(&coding_bytes, data + sizeof(magic) + 1, sizeof(coding_bytes));
+        size_t header_bytes = sizeof(magic) + 1 + sizeof(coding_bytes) + coding_bytes;
+        if (available < header_bytes) {
+          return false;
+        }
+        bitreader coding_in(data + header_bytes - coding_bytes, uint64_t(coding_bytes) * 8);
+        huffman_encoding encoding;
+        if (not encoding.deserialise(coding_in) or std::count(std::begin(encoding.lengths_), std::end(encoding.lengths_), 0) > 0) {
+          // every symbol of the alphabet must have an encoding
+          state_ = state::error;
+          return false;
+        }
+        decoder_.build(encoding);
+        tables_ = &decoder_;
+        in.skip(header_bytes * 8);
+      }
+      state_ = state::segment;
+      return true;
+    }
+
+    static void align(bitreader& in) { in.skip((8 - in.tellg() % 8) % 8); }
+
+    dictionary::cache const* dictionaries_;
+    huffman_decoder decoder_;                // tables of the coding carried by the stream
+    huffman_decoder const* tables_ = nullptr;
+    state state_ = state::header;
+    uint64_t remaining_ = 0;                 // number of symbols of the current segment that are still to be decoded
+    std::vector<uint8_t> pending_;           // bytes received and not consumed yet
+    uint64_t position_ = 0;                  // bit position of the next bit in `pending_`
+  };
+
+}  // namespace streaming
+
+#endif  // streaming_h
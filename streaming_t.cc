@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitwriter.h"
+#include "dictionary.h"
+#include "streaming.h"
+
+// feed the bytes of `writer` to `decoder` in chunks of 1 to `chunk` bytes; return the decoded symbols
+std::vector<uint8_t> feed(streaming::decoder& decoder, bitwriter const& writer, size_t chunk, std::mt19937& random) {
+  std::vector<uint8_t> decoded;
+  for (size_t offset = 0; offset < writer.bytes();) {
+    size_t size = std::min<size_t>(1 + random() % chunk, writer.bytes() - offset);
+    decoder.feed(writer.data() + offset, size, decoded);
+    offset += size;
+    assert(not decoder.error());
+  }
+  return decoded;
+}
+
+// encode `records` as a stream with `encoder`, flushing after each of them; return the stream, and the byte offset of the end
+// of each flush in `ends`
+bitwriter encode(streaming::encoder& encoder, std::vector<std::vector<uint8_t>> const& records, std::vector<size_t>& ends, std::vector<size_t>& symbols) {
+  bitwriter writer;
+  size_t total = 0;
+  for (auto const& record : records) {
+    encoder.push(record.data(), record.size());
+    assert(encoder.pending() == record.size());
+    encoder.flush(writer);
+    assert(encoder.pending() == 0 and writer.size() % 8 == 0);
+    total += record.size();
+    ends.push_back(writer.bytes());
+    symbols.push_back(total);
+  }
+  encoder.finish(writer);
+  ends.push_back(writer.bytes());
+  symbols.push_back(total);
+  return writer;
+}
+
+// check that each record can be decoded as soon as the bytes of its flush have been fed, and without any of the next ones
+void check_latency(bitwriter const& writer, std::vector<size_t> const& ends, std::vector<size_t> const& symbols, std::vector<uint8_t> const& message,
+                   dictionary::cache const* dictionaries) {
+  streaming::decoder decoder(dictionaries);
+  std::vector<uint8_t> decoded;
+  size_t offset = 0;
+  for (size_t i = 0; i < ends.size(); ++i) {
+    decoder.feed(writer.data() + offset, ends[i] - offset, decoded);
+    offset = ends[i];
+    assert(not decoder.error() and decoded.size() == symbols[i]);
+    assert(std::equal(decoded.begin(), decoded.end(), message.begin()));
+    assert(decoder.finished() == (i + 1 == ends.size()));
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  std::mt19937 random(42);
+  std::geometric_distribution<int> distribution(0.2);
+
+  // records of various sizes, including empty ones, with a skewed distribution, and a few symbols that do not appear in the first
+  // record, that must still be encoded with the coding built from it
+  std::vector<std::vector<uint8_t>> records;
+  std::vector<uint8_t> message;
+  for (int i = 0; i < 200; ++i) {
+    std::vector<uint8_t> record(i % 17 == 0 ? 0 : random() % 300);
+    for (auto& symbol : record) {
+      symbol = static_cast<uint8_t>(std::min(distribution(random), 255));
+    }
+    if (i % 50 == 7 and not record.empty()) {
+      record[0] = static_cast<uint8_t>(random());
+    }
+    message.insert(message.end(), record.begin(), record.end());
+    records.push_back(record);
+  }
+
+  // a coding built from the first flush, decoded in chunks of various sizes down to single bytes
+  {
+    streaming::encoder encoder(12);
+    std::vector<size_t> ends, symbols;
+    bitwriter writer = encode(encoder, records, ends, symbols);
+    bool stream = streaming::is_stream(writer.data(), writer.bytes());
+    assert(stream);
+    std::cout << "stream of " << message.size() << " symbols in " << records.size() << " flushes: " << writer.bytes() << " bytes" << std::endl;
+    for (size_t chunk : {1, 2, 7, 64, 100000}) {
+      streaming::decoder decoder;
+      std::vector<uint8_t> decoded = feed(decoder, writer, chunk, random);
+      assert(decoder.finished() and decoded == message);
+
+      // nothing may follow the end of the stream
+      decoder.feed(writer.data(), 1, decoded);
+      assert(decoder.error());
+    }
+    check_latency(writer, ends, symbols, message, nullptr);
+
+    // trailing bytes in the same feed as the end of the stream
+    std::vector<uint8_t> trailing(writer.data(), writer.data() + writer.bytes());
+    trailing.push_back(0);
+    streaming::decoder decoder;
+    std::vector<uint8_t> decoded;
+    decoder.feed(trailing.data(), trailing.size(), decoded);
+    assert(decoder.error() and not decoder.finished());
+
+    // a truncated stream is not finished, but not in error either
+    streaming::decoder truncated;
+    decoded.clear();
+    truncated.feed(writer.data(), writer.bytes() - 1, decoded);
+    assert(not truncated.finished() and not truncated.error() and decoded.size() == message.size());
+
+    // a corrupted magic number
+    std::vector<uint8_t> corrupted(writer.data(), writer.data() + writer.bytes());
+    corrupted[3] ^= 1;
+    streaming::decoder bad;
+    bad.feed(corrupted.data(), corrupted.size(), decoded);
+    assert(bad.error());
+
+    // a coding that is cut short by its size, or that is for a different alphabet
+    size_t coding = sizeof(streaming::magic) + 1;
+    uint32_t coding_bytes;
+    std::memcpy(&coding_bytes, writer.data() + coding, sizeof(coding_bytes));
+    std::vector<uint8_t> cut(writer.data(), writer.data() + writer.bytes());
+    uint32_t cut_bytes = coding_bytes - 8;
+    std::memcpy(cut.data() + coding, &cut_bytes, sizeof(cut_bytes));
+    streaming::decoder short_coding;
+    short_coding.feed(cut.data(), coding + sizeof(cut_bytes) + cut_bytes, decoded);
+    assert(short_coding.error());
+    std::vector<uint8_t> other(writer.data(), writer.data() + writer.bytes());
+    other[coding + sizeof(coding_bytes) + 8] ^= 1;
+    streaming::decoder other_alphabet;
+    other_alphabet.feed(other.data(), other.size(), decoded);
+    assert(other_alphabet.error());
+  }
+
+  // a pre-trained coding, referenced by its identifier
+  {
+    dictionary::cache dictionaries;
+    dictionary::cache::entry const& entry = dictionaries.add(dictionary::train(message.data(), message.size(), 15));
+    streaming::encoder encoder(entry);
+    std::vector<size_t> ends, symbols;
+    bitwriter writer = encode(encoder, records, ends, symbols);
+    check_latency(writer, ends, symbols, message, &dictionaries);
+    for (auto type : {huffman_decoder::table_type::single_symbol, huffman_decoder::table_type::multi_symbol}) {
+      streaming::decoder decoder(&dictionaries, 9, type);
+      std::vector<uint8_t> decoded = feed(decoder, writer, 5, random);
+      assert(decoder.finished() and decoded == message);
+    }
+
+    // the stream cannot be decoded without the dictionary
+    streaming::decoder missing;
+    std::vector<uint8_t> decoded;
+    missing.feed(writer.data(), writer.bytes(), decoded);
+    assert(missing.error() and decoded.empty());
+  }
+
+  // an empty stream, and a stream with a single record of a single symbol
+  for (size_t size : {0, 1}) {
+    streaming::encoder encoder;
+    std::vector<uint8_t> record(size, 'x');
+    std::vector<size_t> ends, symbols;
+    bitwriter writer = encode(encoder, {record}, ends, symbols);
+    streaming::decoder decoder;
+    std::vector<uint8_t> decoded = feed(decoder, writer, 3, random);
+    assert(decoder.finished() and decoded == record);
+  }
+}
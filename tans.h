@@ -0,0 +1,434 @@
+#ifndef tans_h
+#define tans_h
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "cpu.h"
+#include "huffman.h"
+#include "stats.h"
+
+/* table-based asymmetric numeral system (tANS) coding of 8-bit symbols, in the style of FSE
+ *
+ * A Huffman coding spends a whole number of bits on each symbol, so that a symbol with a probability above 1/2 still costs a bit.
+ * A tANS coding approximates the probability of each symbol by a count n out of a table of T = 2^table_log states, and spends
+ * about log2(T / n) bits on it: the state carries the fractional part of the bits from one symbol to the next.
+ *
+ * The weights collected by scan_input() are normalised to counts that add up to T, where each present symbol has a count of at
+ * least one, and the symbols are spread over the table. Decoding a symbol is a single lookup in the table for the current state,
+ * that gives the symbol, the number of bits k to read from the stream, and the base of the next state, to which the k bits are
+ * added; encoding a symbol is the inverse operation, that emits the k lowest bits of the state.
+ *
+ * The encoder works from the last symbol to the first, so that the decoder reads the stream forward: the bits emitted for each
+ * symbol are kept in a scratch buffer, and then written in order with the bulk kernel of the bitwriter. Two states alternate
+ * over the symbols, so that the decoder has two independent lookups in flight. The serialised coding holds:
+ *
+ *   4 bit:             table_log
+ *   6 + N bit:         the size of the encoded message (without the header) in bits, as in the compact Huffman header
+ *   6 + N bit:         the original message size, in symbols, in the same format
+ *   8 bit:             the last present symbol S
+ *   Exp-Golomb codes:  the count of each symbol from 0 to S
+ *
+ * and the encoded message holds the first value of each state, in table_log bits, followed by the bits of the next states.
+ */
+
+namespace detail {
+
+  // the bits emitted by the tANS encoder for a symbol, as codes for the bulk kernel of the bitwriter: a chunk of k bits is stored
+  // with a leading one bit, so that chunk c is written as the code c - 2^k of length k
+  struct tans_chunk_table {
+    static constexpr int max_bits = 12;
+
+    uint16_t codes[2 << max_bits];
+    uint8_t lengths[2 << max_bits];
+
+    constexpr tans_chunk_table() : codes(), lengths() {
+      for (int chunk = 1; chunk < (2 << max_bits); ++chunk) {
+        int length = 0;
+        while ((chunk >> (length + 1)) > 0) {
+          ++length;
+        }
+        codes[chunk] = static_cast<uint16_t>(chunk - (1 << length));
+        lengths[chunk] = static_cast<uint8_t>(length);
+      }
+    }
+  };
+
+  inline constexpr tans_chunk_table tans_chunks{};
+
+}  // namespace detail
+
+class tans_encoding {
+public:
+  using alphabet_type = uint8_t;
+  using count_type = uint16_t;
+  static constexpr int alphabet_size = 256;
+
+  static constexpr int states = 2;                                            // number of states that alternate over the symbols
+  static constexpr int min_table_log = 5;                                     // smallest table, of 32 states
+  static constexpr int max_table_log = detail::tans_chunk_table::max_bits;    // largest table, of 4096 states
+  static constexpr int default_table_log = 11;                                // 2048 states, as many as the Huffman decoding table
+
+  // default constructor: an empty coding
+  tans_encoding() = default;
+
+  // build the coding from the weights collected by the scan_input() of a Huffman coding, with a table of up to 2^table_log states
+  explicit tans_encoding(huffman_encoding const& encoding, int table_log = default_table_log) {
+    build_from_weights(encoding.weights_, encoding.original_size_, table_log);
+  }
+
+  // build the coding from the `weights` of the `size` symbols of a message, with a table of up to 2^table_log states; small
+  // messages get a smaller table, and the table has at least as many states as there are present symbols
+  // NB: encoded_size_ is then only an estimate of the size of the encoded message, until it is encoded by encode()
+  void build_from_weights(uint64_t const* weights, uint64_t size, int table_log = default_table_log) {
+    assert(table_log >= min_table_log and table_log <= max_table_log);
+    stats::timer timer(stats::phase::tables);
+    original_size_ = size;
+    normalise(weights, size, table_log);
+    build_tables();
+
+    // the cost of a symbol with count n is log2(T / n) bits, and the first value of each state takes table_log bits
+    double bits = 0;
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      if (counts_[symbol] > 0) {
+        bits += weights[symbol] * (table_log_ - std::log2(static_cast<double>(counts_[symbol])));
+      }
+    }
+    encoded_size_ = static_cast<uint64_t>(std::ceil(bits)) + std::min<uint64_t>(size, states) * table_log_;
+    update_header_size();
+  }
+
+  // encode the `size` symbols of `data`, that must be the message whose weights built the coding, into the scratch buffer, and
+  // set encoded_size_ to the exact size of the encoded message; write() then appends it to a bitwriter
+  void encode(alphabet_type const* data, size_t size) {
+    assert(size == original_size_);
+    stats::timer timer(stats::phase::coding);
+    chunks_.resize(size);
+    uint32_t total = uint32_t(1) << table_log_;
+    uint32_t state[states] = {};
+    uint64_t bits = 0;
+    for (size_t i = size; i-- > 0;) {
+      alphabet_type symbol = data[i];
+      assert(counts_[symbol] > 0);
+      uint32_t& value = state[i % states];
+      if (i + states >= size) {
+        // the last symbol of each state only sets its value, without emitting any bits
+        value = next_[start_[symbol]];
+        chunks_[i] = 1;
+        continue;
+      }
+      // emit the lowest k bits of the state, so that the rest is in [n, 2n) for the symbol of count n
+      uint32_t k = max_bits_[symbol] - (value < threshold_[symbol]);
+      chunks_[i] = static_cast<uint16_t>((uint32_t(1) << k) | (value & ((uint32_t(1) << k) - 1)));
+      bits += k;
+      value = next_[start_[symbol] + (value >> k) - counts_[symbol]];
+    }
+    for (int k = 0; k < states; ++k) {
+      first_[k] = state[k] >= total ? state[k] - total : 0;
+    }
+    encoded_size_ = std::min<uint64_t>(size, states) * table_log_ + bits;
+    update_header_size();
+  }
+
+  // append the message encoded by encode() to `out`
+  void write(bitwriter& out) const {
+    stats::timer timer(stats::phase::coding);
+    for (size_t k = 0; k < std::min<size_t>(chunks_.size(), states); ++k) {
+      out.write(table_log_, first_[k]);
+    }
+    out.write_codes(chunks_.data(), chunks_.size(), detail::tans_chunks.codes, detail::tans_chunks.lengths, table_log_);
+  }
+
+  // serialise the coding to a bit stream
+  template <typename Stream>
+  void serialise(Stream& stream) const {
+    stream.write(4, table_log_);
+    detail::write_size(stream, encoded_size_);
+    detail::write_size(stream, original_size_);
+    int last = last_symbol();
+    stream.write(8, last);
+    for (int symbol = 0; symbol <= last; ++symbol) {
+      detail::write_exp_golomb(stream, counts_[symbol]);
+    }
+  }
+
+  // deserialise the coding from a bit stream; return false if the counts do not fill the table
+  template <typename Stream>
+  bool deserialise(Stream& stream) {
+    auto begin = stream.tellg();
+    uint64_t table_log = 0, last = 0;
+    stream.read(4, table_log);
+    encoded_size_ = detail::read_size(stream);
+    original_size_ = detail::read_size(stream);
+    stream.read(8, last);
+    if (table_log < min_table_log or table_log > max_table_log) {
+      return false;
+    }
+    table_log_ = static_cast<int>(table_log);
+    uint64_t total = uint64_t(1) << table_log_, sum = 0;
+    std::fill(std::begin(counts_), std::end(counts_), 0);
+    for (uint64_t symbol = 0; symbol <= last; ++symbol) {
+      uint64_t count = detail::read_exp_golomb(stream);
+      if (count > total - sum) {
+        return false;
+      }
+      counts_[symbol] = static_cast<count_type>(count);
+      sum += count;
+    }
+    header_size_ = stream.tellg() - begin;
+    if (sum != (original_size_ > 0 ? total : 0)) {
+      return false;
+    }
+    build_tables();
+    return true;
+  }
+
+  // spread the symbols of the table of 2^table_log states over `symbols`, each one at as many entries as its count, so that the
+  // entries of each symbol are scattered over the whole table
+  static void spread(count_type const* counts, int table_log, alphabet_type* symbols) {
+    uint32_t mask = (uint32_t(1) << table_log) - 1;
+    // an odd step visits every entry of the table once
+    uint32_t step = (mask + 1) / 2 + (mask + 1) / 8 + 3;
+    uint32_t position = 0;
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      for (uint32_t i = 0; i < counts[symbol]; ++i) {
+        symbols[position] = static_cast<alphabet_type>(symbol);
+        position = (position + step) & mask;
+      }
+    }
+  }
+
+  // number of bits used to index the table of states
+  int table_log_ = min_table_log;
+
+  // size of the header (in bits)
+  uint64_t header_size_ = 0;
+
+  // size of the decoded (original) message (in symbols), and of the encoded version (in bits)
+  uint64_t original_size_ = 0;
+  uint64_t encoded_size_ = 0;
+
+  // normalised count of each symbol, out of 2^table_log_
+  count_type counts_[alphabet_size] = {};
+
+private:
+  // normalise `weights` to counts that add up to a power of two, in proportion to the weights; the rounding error is absorbed by
+  // the largest counts, which it changes the least in proportion
+  void normalise(uint64_t const* weights, uint64_t size, int table_log) {
+    std::fill(std::begin(counts_), std::end(counts_), 0);
+    int present = 0;
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      present += weights[symbol] > 0;
+    }
+    table_log_ = table_log;
+    while (table_log_ > min_table_log and (uint64_t(1) << (table_log_ - 1)) >= size) {
+      --table_log_;
+    }
+    table_log_ = std::max(table_log_, detail::bits_for(present));
+    if (size == 0) {
+      return;
+    }
+
+    int64_t total = int64_t(1) << table_log_, sum = 0;
+    int largest = 0;
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      if (weights[symbol] > 0) {
+        int64_t count = std::max<int64_t>(1, std::llround(static_cast<double>(weights[symbol]) * total / size));
+        counts_[symbol] = static_cast<count_type>(std::min(count, total));
+        sum += counts_[symbol];
+        if (weights[symbol] > weights[largest]) {
+          largest = symbol;
+        }
+      }
+    }
+    if (sum < total) {
+      counts_[largest] += static_cast<count_type>(total - sum);
+      return;
+    }
+    while (sum > total) {
+      int symbol = static_cast<int>(std::max_element(std::begin(counts_), std::end(counts_)) - std::begin(counts_));
+      int64_t cut = std::min<int64_t>(counts_[symbol] - 1, sum - total);
+      counts_[symbol] -= static_cast<count_type>(cut);
+      sum -= cut;
+    }
+  }
+
+  // build the encoding tables from the counts
+  void build_tables() {
+    if (original_size_ == 0) {
+      return;
+    }
+    uint32_t total = uint32_t(1) << table_log_;
+    alphabet_type symbols[1 << max_table_log];
+    spread(counts_, table_log_, symbols);
+
+    // the states of each symbol are consecutive in next_, in the order of their entries in the table
+    uint32_t next[alphabet_size];
+    uint32_t start = 0;
+    for (int symbol = 0; symbol < alphabet_size; ++symbol) {
+      start_[symbol] = start;
+      next[symbol] = start;
+      start += counts_[symbol];
+      if (counts_[symbol] > 0) {
+        max_bits_[symbol] = table_log_ - (detail::significant_bits(counts_[symbol]) - 1);
+        threshold_[symbol] = uint32_t(counts_[symbol]) << max_bits_[symbol];
+      }
+    }
+    for (uint32_t position = 0; position < total; ++position) {
+      next_[next[symbols[position]]++] = static_cast<uint16_t>(total + position);
+    }
+  }
+
+  // last symbol with a nonzero count, or 0 if there is none
+  int last_symbol() const {
+    int last = alphabet_size - 1;
+    while (last > 0 and counts_[last] == 0) {
+      --last;
+    }
+    return last;
+  }
+
+  void update_header_size() {
+    detail::bit_counter counter;
+    serialise(counter);
+    header_size_ = counter.size;
+  }
+
+  uint32_t start_[alphabet_size] = {};      // index in next_ of the states of each symbol
+  uint32_t max_bits_[alphabet_size] = {};   // largest number of bits emitted for each symbol
+  uint32_t threshold_[alphabet_size] = {};  // states below which one bit less is emitted for each symbol
+  uint16_t next_[1 << max_table_log] = {};  // the states of each symbol, as values in [T, 2T)
+  uint32_t first_[states] = {};             // first value of each state, as an index into the table
+  std::vector<uint16_t> chunks_;            // bits emitted for each symbol of the last encoded message, with a leading one bit
+};
+
+/* table-driven decoder for a tANS coding
+ *
+ * Each entry of the table gives the decoded symbol, and the number of bits to add to its base to get the next state; with the
+ * default of 2^11 states the table takes 8 KiB, and stays in the L1 cache. The loop that decodes a buffer of symbols from a
+ * bitreader refills the bit buffer once for four symbols, and has a variant compiled for AVX2 and BMI2, selected at run time (see
+ * cpu.h).
+ */
+
+class tans_decoder {
+public:
+  using alphabet_type = tans_encoding::alphabet_type;
+
+  struct entry_type {
+    uint16_t base = 0;         // next state, before adding the bits read from the stream
+    alphabet_type symbol = 0;  // decoded symbol
+    uint8_t bits = 0;          // number of bits to read from the stream
+  };
+
+  // construct an empty decoder; build() must be called before decoding any symbol
+  tans_decoder() = default;
+
+  // build the decoding table from a tANS coding
+  explicit tans_decoder(tans_encoding const& encoding) { build(encoding); }
+
+  // (re)build the decoding table from a tANS coding
+  void build(tans_encoding const& encoding) {
+    stats::timer timer(stats::phase::tables);
+    table_log_ = encoding.table_log_;
+    if (encoding.original_size_ == 0) {
+      return;
+    }
+    uint32_t total = uint32_t(1) << table_log_;
+    alphabet_type symbols[1 << tans_encoding::max_table_log];
+    tans_encoding::spread(encoding.counts_, table_log_, symbols);
+
+    // the j-th entry of a symbol of count n continues from the value n + j, to which the bits of the stream are appended until
+    // it is back into [T, 2T)
+    uint32_t next[tans_encoding::alphabet_size];
+    std::copy(std::begin(encoding.counts_), std::end(encoding.counts_), next);
+    for (uint32_t position = 0; position < total; ++position) {
+      alphabet_type symbol = symbols[position];
+      uint32_t value = next[symbol]++;
+      int bits = table_log_ - (detail::significant_bits(value) - 1);
+      table_[position] = {static_cast<uint16_t>((value << bits) - total), symbol, static_cast<uint8_t>(bits)};
+    }
+  }
+
+  // number of bits used to index the table
+  int table_log() const { return table_log_; }
+
+  /// read and decode up to `count` symbols from a bit reader into `out`, and return the number of symbols actually decoded
+  size_t decode(bitreader& stream, alphabet_type* out, size_t count) const {
+    stats::timer timer(stats::phase::coding);
+#if WITHER_DISPATCH
+    if (cpu::selected() >= cpu::level::avx2) {
+      return decode_buffer_avx2(stream, out, count);
+    }
+#endif
+    return decode_buffer_scalar(stream, out, count);
+  }
+
+private:
+  static constexpr int states = tans_encoding::states;
+  static constexpr size_t step = 4;  // number of symbols decoded for each refill of the bit buffer
+
+  static_assert(step % states == 0 and step * tans_encoding::max_table_log <= bitreader::min_bits,
+                "the bits of a step must fit in the bit buffer");
+
+  // decode up to `count` symbols from a bit reader into `out`
+  [[gnu::always_inline]] size_t decode_buffer(bitreader& stream, alphabet_type* out, size_t count) const {
+    uint32_t state[states] = {};
+    for (size_t k = 0; k < std::min<size_t>(count, states); ++k) {
+      if (stream.read(table_log_, state[k]) != static_cast<bitreader::size_type>(table_log_)) {
+        return 0;
+      }
+    }
+
+    // decode directly from the bit buffer of a local copy of the reader, as long as a whole word is available in the stream and
+    // all the symbols of the step are followed by the bits of their next state
+    size_t decoded = 0;
+    bitreader local = stream;
+    while (count - decoded >= step + states and local.has_word()) {
+      local.refill();
+      for (size_t i = 0; i < step; ++i) {
+        entry_type const& entry = table_[state[i % states]];
+        out[decoded + i] = entry.symbol;
+        state[i % states] = entry.base + static_cast<uint32_t>(local.peek(entry.bits));
+        local.consume(entry.bits);
+      }
+      decoded += step;
+    }
+    stream = local;
+
+    // decode the last symbols, checking for the end of the stream; the last symbol of each state has no next state
+    for (; decoded < count; ++decoded) {
+      entry_type const& entry = table_[state[decoded % states]];
+      out[decoded] = entry.symbol;
+      if (decoded + states < count) {
+        uint32_t bits = 0;
+        if (stream.read(entry.bits, bits) != entry.bits) {
+          return decoded + 1;
+        }
+        state[decoded % states] = entry.base + bits;
+      }
+    }
+    return decoded;
+  }
+
+  // the loop compiled for the baseline of the architecture, kept out of line as in basic_huffman_decoder
+  [[gnu::noinline]] size_t decode_buffer_scalar(bitreader& stream, alphabet_type* out, size_t count) const {
+    return decode_buffer(stream, out, count);
+  }
+
+#if WITHER_DISPATCH
+  // the same loop, compiled for AVX2 and BMI2
+  WITHER_TARGET_AVX2 size_t decode_buffer_avx2(bitreader& stream, alphabet_type* out, size_t count) const {
+    return decode_buffer(stream, out, count);
+  }
+#endif
+
+  int table_log_ = tans_encoding::min_table_log;
+  entry_type table_[1 << tans_encoding::max_table_log];
+};
+
+#endif  // tans_h
@@ -0,0 +1,127 @@
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "bitreader.h"
+#include "bitwriter.h"
+#include "container.h"
+#include "decoder.h"
+#include "huffman.h"
+#include "tans.h"
+
+// encode `size` symbols of `data` with a tANS coding of up to 2^table_log states, decode them back, and return the size of the
+// encoded message in bits
+uint64_t round_trip(uint8_t const* data, size_t size, int table_log) {
+  huffman_encoding weights;
+  weights.scan_input(data, size);
+  tans_encoding encoding(weights, table_log);
+  assert(encoding.table_log_ <= std::max(table_log, 8));
+  uint64_t estimate = encoding.encoded_size_;
+  encoding.encode(data, size);
+  // the estimate is the cross-entropy of the message with the normalised counts, that the spread of the states over the table only
+  // approximates, to within a few percent
+  assert(encoding.encoded_size_ <= estimate + estimate / 20 + 32 and estimate <= encoding.encoded_size_ + encoding.encoded_size_ / 20 + 32);
+
+  bitwriter writer;
+  encoding.serialise(writer);
+  assert(writer.size() == encoding.header_size_);
+  encoding.write(writer);
+  assert(writer.size() == encoding.header_size_ + encoding.encoded_size_);
+  writer.flush();
+
+  bitreader reader(writer.data(), writer.size());
+  tans_encoding decoded_encoding;
+  bool valid = decoded_encoding.deserialise(reader);
+  assert(valid);
+  assert(decoded_encoding.header_size_ == encoding.header_size_ and decoded_encoding.encoded_size_ == encoding.encoded_size_);
+  assert(decoded_encoding.original_size_ == size and decoded_encoding.table_log_ == encoding.table_log_);
+  tans_decoder decoder(decoded_encoding);
+  std::vector<uint8_t> decoded(size);
+  size_t decoded_size = decoder.decode(reader, decoded.data(), size);
+  assert(decoded_size == size);
+  assert(reader.tellg() == reader.size());
+  assert(std::equal(decoded.begin(), decoded.end(), data));
+
+  // a truncated message is detected
+  if (encoding.encoded_size_ > 0) {
+    bitreader truncated(writer.data(), writer.size() - 1);
+    truncated.skip(encoding.header_size_);
+    decoded_size = decoder.decode(truncated, decoded.data(), size);
+    assert(decoded_size < size or truncated.tellg() < writer.size());
+  }
+  return encoding.encoded_size_;
+}
+
+int main(int argc, const char* argv[]) {
+  // skewed messages, where the most frequent symbol has a probability of 95%, and uniform ones
+  std::mt19937 random(42);
+  std::vector<uint8_t> skewed(200000), uniform(200000), pair(200000);
+  for (size_t i = 0; i < skewed.size(); ++i) {
+    skewed[i] = random() % 20 == 0 ? random() % 16 : 0;
+    uniform[i] = random();
+    pair[i] = random() % 3 == 0;
+  }
+
+  for (auto const* message : {&skewed, &uniform, &pair}) {
+    for (size_t size : {size_t(0), size_t(1), size_t(2), size_t(3), size_t(5), size_t(100), size_t(4096), message->size()}) {
+      for (int table_log : {tans_encoding::min_table_log, tans_encoding::default_table_log, tans_encoding::max_table_log}) {
+        round_trip(message->data(), size, table_log);
+      }
+    }
+  }
+
+  // the fractional bits make the skewed message much smaller than with a Huffman coding, that spends at least a bit per symbol
+  huffman_encoding huffman(skewed.data(), skewed.size(), 15);
+  uint64_t bits = round_trip(skewed.data(), skewed.size(), tans_encoding::default_table_log);
+  std::cout << "skewed message: " << double(bits) / skewed.size() << " bits per symbol with tANS, "
+            << double(huffman.encoded_size_) / skewed.size() << " with Huffman" << std::endl;
+  assert(bits < huffman.encoded_size_ / 2);
+  assert(round_trip(uniform.data(), uniform.size(), tans_encoding::default_table_log) <= uniform.size() * 8 + 64);
+
+  // counts that do not fill the table are rejected
+  {
+    bitwriter writer;
+    writer.write(4, tans_encoding::min_table_log);
+    writer.write(6, 0);  // encoded size
+    writer.write(6, 1);  // original size
+    writer.write(1, 1);
+    writer.write(8, 0);  // last present symbol
+    writer.write(1, 1);  // a count of 0
+    writer.flush();
+    bitreader reader(writer.data(), writer.size());
+    tans_encoding encoding;
+    bool valid = encoding.deserialise(reader);
+    assert(not valid);
+  }
+
+  // the block encoder picks a tANS block for the skewed blocks, and a Huffman block for the others
+  {
+    std::vector<uint8_t> input(skewed.begin(), skewed.begin() + 100000);
+    input.insert(input.end(), uniform.begin(), uniform.begin() + 100000);
+    bitwriter out;
+    container::block_encoder encoder(15, 1, true);
+    for (size_t offset = 0; offset < input.size(); offset += 50000) {
+      encoder.encode(input.data() + offset, 50000, out);
+    }
+    out.flush();
+
+    huffman_decoder decoder;
+    std::vector<uint8_t> decoded(input.size());
+    size_t offset = 0, position = 0;
+    std::vector<container::block_type> types;
+    while (offset < out.bytes()) {
+      container::block_header header = container::read_block_header(out.data() + offset);
+      types.push_back(header.type);
+      bool valid = container::decode_block(header, out.data() + offset + container::block_header_size, decoded.data() + position, decoder);
+      assert(valid);
+      offset += container::block_header_size + header.payload_size;
+      position += header.symbols;
+    }
+    assert(decoded == input);
+    assert(types.size() == 4 and types[0] == container::block_type::tans and types[1] == container::block_type::tans);
+    assert(types[2] != container::block_type::tans and types[3] != container::block_type::tans);
+  }
+}
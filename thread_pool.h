@@ -0,0 +1,98 @@
+#ifndef thread_pool_h
+#define thread_pool_h
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* fixed-size pool of worker threads, that execute the submitted tasks in FIFO order
+ *
+ * A pool with no worker threads executes each task synchronously in submit(), so that the same code can be used for the
+ * single-threaded case without any overhead.
+ */
+
+class thread_pool {
+public:
+  // start `threads` worker threads
+  explicit thread_pool(unsigned int threads) {
+    workers_.reserve(threads);
+    for (unsigned int i = 0; i < threads; ++i) {
+      workers_.emplace_back([this] { work(); });
+    }
+  }
+
+  // wait for all the submitted tasks to complete, and stop the worker threads
+  ~thread_pool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    condition_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  thread_pool(thread_pool const&) = delete;
+  thread_pool& operator=(thread_pool const&) = delete;
+
+  // number of worker threads
+  unsigned int size() const { return workers_.size(); }
+
+  // submit `task` for execution, and return a future for its result
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& task) {
+    using result_type = std::invoke_result_t<F>;
+    // std::function requires a copyable callable, so the packaged_task is held by a shared_ptr
+    auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::forward<F>(task));
+    std::future<result_type> result = packaged->get_future();
+    if (workers_.empty()) {
+      (*packaged)();
+      return result;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      tasks_.emplace([packaged] { (*packaged)(); });
+    }
+    condition_.notify_one();
+    return result;
+  }
+
+  // number of hardware threads, or 1 if it cannot be determined
+  static unsigned int hardware_threads() {
+    unsigned int threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+  }
+
+private:
+  // execute the tasks from the queue until the pool is stopped and the queue is empty
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this] { return stop_ or not tasks_.empty(); });
+        if (tasks_.empty()) {
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::queue<std::function<void()>> tasks_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool stop_ = false;
+};
+
+#endif  // thread_pool_h